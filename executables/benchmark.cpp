@@ -0,0 +1,224 @@
+// Benchmark of the different evaluations of the triangle
+//
+// Sweeps every available channel, several decay masses, and regions in s
+// (below threshold, around the pseudo-threshold, and far above) and reports
+// the wall time and accuracy of each method as CSV (default) or JSON.
+// Accuracy is measured relative to the Feynman evaluation with the y-integral
+// done analytically with the publication policy, and reported as the number of
+// correct digits along with the time and integrand calls per digit of each method.
+// The relative error estimate of the reference is given with every entry
+// (ref_error) and no method is credited with more digits than it allows.
+// The dispersive evaluation is done with Gauss-Kronrod, tanh-sinh between the
+// branch points, and tanh-sinh with exp-sinh for the tail.
+// Integrand call counts are only available if compiled with -DINSTRUMENT=ON
+//
+// Usage: benchmark [-o file] [-json] [-no2D] [-id id] [-tier fast|fit|publication]
+// The reference is always evaluated with the publication policy while the
+// other methods use the settings of the chosen tier.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#include "feynman/feynman_triangle.hpp"
+#include "dispersive/dispersive_triangle.hpp"
+#include "quantum_numbers.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// One line of output
+struct bench_entry
+{
+  int id;
+  double mDec, s;
+  std::string region, method;
+  double tol, time;
+  long calls;
+  std::complex<double> value;
+  double error, rel_diff, ref_error;
+
+  // Correct digits relative to the reference, up to its own accuracy
+  inline double digits()
+  {
+    return - log10(std::max(std::max(rel_diff, ref_error), 1.E-16));
+  };
+
+  // Cost per correct digit
+  inline double time_per_digit()
+  {
+    return (digits() > 0.) ? time / digits() : std::numeric_limits<double>::infinity();
+  };
+  inline double calls_per_digit()
+  {
+    return (digits() > 0.) ? double(calls) / digits() : std::numeric_limits<double>::infinity();
+  };
+};
+
+int main( int argc, char** argv )
+{
+  std::string filename = "";
+  bool json = false, do2D = true;
+  std::vector<int> ids = {0, 1, 10, 11, 20, 10000, -11111};
+  accuracy_policy policy;
+
+  // Parse inputs
+  for (int i = 0; i < argc; i++)
+  {
+    if (std::strcmp(argv[i],"-o")==0)    filename = argv[i+1];
+    if (std::strcmp(argv[i],"-json")==0) json = true;
+    if (std::strcmp(argv[i],"-no2D")==0) do2D = false;
+    if (std::strcmp(argv[i],"-id")==0)   ids = {atoi(argv[i+1])};
+    if (std::strcmp(argv[i],"-tier")==0)
+    {
+      if (std::strcmp(argv[i+1],"fast")==0)        policy = accuracy_policy::fast_scan();
+      if (std::strcmp(argv[i+1],"fit")==0)         policy = accuracy_policy::fit();
+      if (std::strcmp(argv[i+1],"publication")==0) policy = accuracy_policy::publication();
+    }
+  }
+
+  // Decay masses to test
+  std::vector<double> masses = {.780, 1.020, 1.230};
+
+  // Exchange mass
+  double t = mRho2;
+
+// ---------------------------------------------------------------------------
+// You shouldnt need to change anything below this line
+// ---------------------------------------------------------------------------
+
+  std::vector<bench_entry> entries;
+
+  // Time a single evaluation
+  auto timed = [] (std::function<std::complex<double>()> f, double & ms)
+  {
+    auto begin = std::chrono::steady_clock::now();
+    std::complex<double> result = f();
+    auto end = std::chrono::steady_clock::now();
+    ms = 1.E3 * std::chrono::duration<double>(end - begin).count();
+    return result;
+  };
+
+  for (int m = 0; m < masses.size(); m++)
+  {
+    for (int k = 0; k < ids.size(); k++)
+    {
+      quantum_numbers qns;
+      qns.n = 1;
+      qns.set_id(ids[k]);
+      qns.mDec = masses[m];
+
+      accuracy_policy ref_policy = accuracy_policy::publication();
+      feynman_triangle tri_feyn(&qns, policy), tri_an(&qns, ref_policy);
+      tri_an.set_analytic(true);
+
+      dispersive_triangle tri_disp(&qns, policy), tri_int(&qns, policy);
+      tri_int.set_interpolation(true);
+
+      // Same with the double exponential rules
+      accuracy_policy ts_policy = policy, es_policy = policy;
+      ts_policy.interval_rule = kTanhSinh; ts_policy.tail_rule = kTanhSinh;
+      es_policy.interval_rule = kTanhSinh; es_policy.tail_rule = kExpSinh;
+      dispersive_triangle tri_ts(&qns, ts_policy), tri_es(&qns, es_policy);
+
+      // Regions in s
+      double p_thresh = (qns.mDec - mPi) * (qns.mDec - mPi);
+      std::vector<std::string> regions = {"below_threshold", "below_pseudo", "above_pseudo", "far_above"};
+      std::vector<double> s = {0.5 * sthPi, p_thresh - 1.E-3, p_thresh + 1.E-3, 81. * mPi2};
+
+      for (int i = 0; i < s.size(); i++)
+      {
+        std::vector<bench_entry> point;
+        double ms;
+        std::complex<double> fx;
+
+        fx = timed([&](){ return tri_an.eval(s[i], t); }, ms);
+        point.push_back({ids[k], qns.mDec, s[i], regions[i], "feynman_1D_reference", ref_policy.gk_tol, ms, tri_an.stats().calls(), fx, tri_an.error(), 0., 0.});
+
+        if (do2D)
+        {
+          fx = timed([&](){ return tri_feyn.eval(s[i], t); }, ms);
+          point.push_back({ids[k], qns.mDec, s[i], regions[i], "feynman_2D", policy.cubature_tol, ms, tri_feyn.stats().calls(), fx, tri_feyn.error(), 0., 0.});
+        }
+
+        fx = timed([&](){ return tri_disp.eval(s[i], t); }, ms);
+        point.push_back({ids[k], qns.mDec, s[i], regions[i], "dispersive", policy.gk_tol, ms, tri_disp.stats().calls(), fx, tri_disp.error(), 0., 0.});
+
+        fx = timed([&](){ return tri_ts.eval(s[i], t); }, ms);
+        point.push_back({ids[k], qns.mDec, s[i], regions[i], "dispersive_tanh_sinh", policy.gk_tol, ms, tri_ts.stats().calls(), fx, tri_ts.error(), 0., 0.});
+
+        fx = timed([&](){ return tri_es.eval(s[i], t); }, ms);
+        point.push_back({ids[k], qns.mDec, s[i], regions[i], "dispersive_exp_sinh", policy.gk_tol, ms, tri_es.stats().calls(), fx, tri_es.error(), 0., 0.});
+
+        fx = timed([&](){ return tri_int.eval(s[i], t); }, ms);
+        point.push_back({ids[k], qns.mDec, s[i], regions[i], "interpolated", 1.E-6, ms, tri_int.stats().calls(), fx, tri_int.error(), 0., 0.});
+
+        // Compare everything to the analytic Feynman evaluation
+        std::complex<double> reference = point[0].value;
+        double ref_error = point[0].error / std::abs(reference);
+        for (int j = 0; j < point.size(); j++)
+        {
+          point[j].rel_diff = std::abs(point[j].value - reference) / std::abs(reference);
+          point[j].ref_error = ref_error;
+          entries.push_back(point[j]);
+        }
+      }
+    }
+  }
+
+  // Output
+  std::ofstream file;
+  if (filename != "") file.open(filename);
+  std::ostream & out = (filename != "") ? file : std::cout;
+  out << std::setprecision(10);
+
+  if (json)
+  {
+    // No correct digits has infinite cost which JSON cant represent
+    auto json_number = [](double x)
+    {
+      std::ostringstream str;
+      if (std::isfinite(x)) str << std::setprecision(10) << x;
+      else                  str << "null";
+      return str.str();
+    };
+
+    out << "[\n";
+    for (int i = 0; i < entries.size(); i++)
+    {
+      bench_entry & e = entries[i];
+      out << "  {\"id\": " << e.id << ", \"mDec\": " << e.mDec << ", \"s\": " << e.s;
+      out << ", \"region\": \"" << e.region << "\", \"method\": \"" << e.method << "\"";
+      out << ", \"tol\": " << e.tol << ", \"time_ms\": " << e.time << ", \"calls\": " << e.calls;
+      out << ", \"re\": " << std::real(e.value) << ", \"im\": " << std::imag(e.value);
+      out << ", \"error\": " << e.error << ", \"rel_diff\": " << e.rel_diff << ", \"ref_error\": " << e.ref_error;
+      out << ", \"digits\": " << e.digits();
+      out << ", \"ms_per_digit\": " << json_number(e.time_per_digit());
+      out << ", \"calls_per_digit\": " << json_number(e.calls_per_digit()) << "}";
+      out << ((i < entries.size() - 1) ? ",\n" : "\n");
+    }
+    out << "]\n";
+  }
+  else
+  {
+    out << "id,mDec,s,region,method,tol,time_ms,calls,re,im,error,rel_diff,ref_error,digits,ms_per_digit,calls_per_digit\n";
+    for (int i = 0; i < entries.size(); i++)
+    {
+      bench_entry & e = entries[i];
+      out << e.id << "," << e.mDec << "," << e.s << "," << e.region << "," << e.method << ",";
+      out << e.tol << "," << e.time << "," << e.calls << "," << std::real(e.value) << "," << std::imag(e.value) << ",";
+      out << e.error << "," << e.rel_diff << "," << e.ref_error << "," << e.digits() << "," << e.time_per_digit() << "," << e.calls_per_digit() << "\n";
+    }
+  }
+
+  if (filename != "") file.close();
+
+  return 0;
+};
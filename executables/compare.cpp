@@ -11,12 +11,13 @@
 #include "feynman/feynman_triangle.hpp"
 #include "dispersive/dispersive_triangle.hpp"
 #include "quantum_numbers.hpp"
+#include "parallel_scan.hpp"
 
 #include "jpacGraph1Dc.hpp"
 
 #include <cstring>
 #include <string>
-#include <ctime>
+#include <chrono>
 
 int main( int argc, char** argv )
 {
@@ -36,9 +37,9 @@ int main( int argc, char** argv )
   qns.set_id(id);
   qns.mDec = .780; // The decaying particle mass
 
-  // Initialize a triangle object
-  feynman_triangle tri_feyn(&qns);
-  dispersive_triangle tri_disp(&qns);
+  // Initialize a parallel scan for each triangle
+  parallel_scan<feynman_triangle> tri_feyn(qns);
+  parallel_scan<dispersive_triangle> tri_disp(qns);
 
   // Choose the name for the output files to have (sans and extentions)
   std::string filename = "omega_compare.pdf";
@@ -64,39 +65,39 @@ int main( int argc, char** argv )
   std::cout << std::setw(30) << "feynman";
   std::cout << std::setw(15) << "abs(disp - feyn)" << std::endl;
 
-  std::vector<double> s;
-  std::vector< std::complex<double> > feyn, disp;
-
-  clock_t begin = clock();
-
+  std::vector<double> s, sqs;
   for (int i = 0; i <= Np; i++)
   {
     double si = low + EPS + double(i) * (high - low) / double(Np);
-    s.push_back(sqrt(si) / mPi);
+    s.push_back(si);
+    sqs.push_back(sqrt(si) / mPi);
+  }
 
-    std::complex<double> fx_f = tri_feyn.eval(si, mRho2);
-    feyn.push_back(fx_f);
+  auto begin = std::chrono::steady_clock::now();
 
-    std::complex<double> fx_d = tri_disp.eval(si, mRho2);
-    disp.push_back(fx_d);
+  // Evaluate all points on every available core
+  std::vector< std::complex<double> > feyn = tri_feyn.eval(s, mRho2, id);
+  std::vector< std::complex<double> > disp = tri_disp.eval(s, mRho2, id);
 
+  for (int i = 0; i <= Np; i++)
+  {
     std::cout << std::left;
     std::cout << std::setw(7)  << i;
-    std::cout << std::setw(15) << sqrt(si) / mPi;
-    std::cout << std::setw(30) << fx_d;
-    std::cout << std::setw(30) << fx_f;
-    std::cout << std::setw(15) << std::abs(fx_d - fx_f) << std::endl;
+    std::cout << std::setw(15) << sqs[i];
+    std::cout << std::setw(30) << disp[i];
+    std::cout << std::setw(30) << feyn[i];
+    std::cout << std::setw(15) << std::abs(disp[i] - feyn[i]) << std::endl;
   }
 
-  clock_t end = clock();
-  double elapsed_secs = double(end - begin) / CLOCKS_PER_SEC;
+  auto end = std::chrono::steady_clock::now();
+  double elapsed_secs = std::chrono::duration<double>(end - begin).count();
 
   std::cout << "\nDone in " << elapsed_secs << " seconds. \n";
   std::cout << "\n";
 
   jpacGraph1Dc* plotter = new jpacGraph1Dc();
-  plotter->AddEntry(s, feyn, "feynman");
-  plotter->AddEntry(s, disp, "dispersive");
+  plotter->AddEntry(sqs, feyn, "feynman");
+  plotter->AddEntry(sqs, disp, "dispersive");
 
   plotter->SetLegend(0.75, 0.75);
 
@@ -9,6 +9,8 @@
 #include "constants.hpp"
 #include "dispersive/dispersive_triangle.hpp"
 #include "dispersive/projection_function.hpp"
+#include "smeared_triangle.hpp"
+#include "breit_wigner.hpp"
 
 #include "jpacGraph1Dc.hpp"
 
@@ -22,11 +24,13 @@ int main(int argc, char** argv)
 {
   // Desired quantum numbers
   int id = 0;
+  double width = 0.; // Width of the exchanged rho, zero for fixed mass
 
   // Parse inputs
   for (int i = 0; i < argc; i++)
   {
     if (std::strcmp(argv[i],"-id")==0)    id = atof(argv[i+1]);
+    if (std::strcmp(argv[i],"-width")==0) width = atof(argv[i+1]);
   }
 
   // All the associated quantum numbers for the amplitude
@@ -60,24 +64,39 @@ int main(int argc, char** argv)
   std::cout << "Calculating Dispersive triangle ";
   std::cout << std::to_string(qns.id()) << "... \n";
 
-  std::vector<double> s;
-  std::vector< std::complex<double> > disp;
-
-  clock_t begin = clock();
-
+  std::vector<double> s, sqs;
   for (int i = 0; i < Np; i++)
   {
     double si = low + double(i) * (high - low) / double(Np);
+    s.push_back(si);
+    sqs.push_back(sqrt(si) / mPi);
+  }
+
+  clock_t begin = clock();
 
-    std::complex<double> fx_d = tri.eval(si, mRho2);
+  // Evaluate the whole grid at once
+  std::vector< std::complex<double> > disp;
+  if (width > 0.)
+  {
+    // Average over the rho lineshape within three widths of the peak
+    breit_wigner rho(mRho, width);
+    double t_low  = std::max(sthPi, (mRho - 3.*width) * (mRho - 3.*width));
+    double t_high = (mRho + 3.*width) * (mRho + 3.*width);
 
-    s.push_back(sqrt(si) / mPi);
-    disp.push_back(fx_d);
+    smeared_triangle<dispersive_triangle> smeared(&qns, &rho, t_low, t_high);
+    disp = smeared.eval(s);
+  }
+  else
+  {
+    disp = tri.eval(s, mRho2);
+  }
 
+  for (int i = 0; i < Np; i++)
+  {
     std::cout << std::left;
     std::cout << std::setw(7)  << i;
-    std::cout << std::setw(15) << sqrt(si) / mPi;
-    std::cout << std::setw(30) << fx_d << std::endl;
+    std::cout << std::setw(15) << sqs[i];
+    std::cout << std::setw(30) << disp[i] << std::endl;
   }
 
   clock_t end = clock();
@@ -87,7 +106,7 @@ int main(int argc, char** argv)
   std::cout << "\n";
 
   jpacGraph1Dc* plotter = new jpacGraph1Dc();
-  plotter->AddEntry(s, disp, "");
+  plotter->AddEntry(sqs, disp, "");
   plotter->SetLegend(false);
 
   plotter->SetXaxis("#sqrt{s} / m_{#pi}", 0, 10);
@@ -8,23 +8,30 @@
 #include "feynman/feynman_triangle.hpp"
 #include "dispersive/dispersive_triangle.hpp"
 #include "quantum_numbers.hpp"
+#include "parallel_scan.hpp"
+#include "result_sink.hpp"
 
 #include "jpacGraph1Dc.hpp"
 
 #include <cstring>
 #include <string>
-#include <ctime>
+#include <chrono>
 
 int main( int argc, char** argv )
 {
   // Desired quantum numbers
   int id = 0;
   int Np = 20;
-  
+
+  // Optional file (.csv or .bin) the points are saved to as they finish
+  // Running again with the same file only evaluates the points missing from it
+  std::string output = "";
+
   // Parse inputs
   for (int i = 0; i < argc; i++)
   {
     if (std::strcmp(argv[i],"-id")==0) id = atoi(argv[i+1]);
+    if (std::strcmp(argv[i],"-o")==0)  output = argv[i+1];
   }
 
   // All the associated quantum numbers for the amplitude
@@ -33,8 +40,8 @@ int main( int argc, char** argv )
   qns.set_id(id);
   qns.mDec = .780; // The decaying particle mass
 
-  // Initialize a triangle object
-  feynman_triangle tri_feyn(&qns);
+  // Initialize a parallel scan of the triangle
+  parallel_scan<feynman_triangle> tri_feyn(qns);
 
   // Choose the name for the output files to have (sans and extentions)
   std::string filename = "omega_feyn.pdf";
@@ -53,34 +60,49 @@ int main( int argc, char** argv )
   std::cout << "\n";
   std::cout << "Calculating Feynman triangle... \n\n";
 
-  std::vector<double> s;
-  std::vector< std::complex<double> > feyn, disp;
-
-  clock_t begin = clock();
-
+  std::vector<double> s, sqs;
   for (int i = 0; i <= Np; i++)
   {
     double si = low + EPS + double(i) * (high - low) / double(Np);
-    s.push_back(sqrt(si) / mPi);
+    s.push_back(si);
+    sqs.push_back(sqrt(si) / mPi);
+  }
+
+  auto begin = std::chrono::steady_clock::now();
+
+  // Points of another scan (decay mass, subtractions, method or tolerance) arent resumed
+  scan_config config(qns, kFeynman2D, accuracy_policy().cubature_tol);
 
-    std::complex<double> fx_f = tri_feyn.eval(si, mRho2);
-    feyn.push_back(fx_f);
+  result_sink * sink = NULL;
+  if (output.size() > 4 && output.substr(output.size() - 4) == ".bin") sink = new binary_sink(output, config);
+  else if (output != "") sink = new csv_sink(output, config);
 
+  if (sink != NULL && sink->previous().size() > 0)
+  {
+    std::cout << "Resuming with " << sink->previous().size() << " points from " << output << "\n\n";
+  }
+
+  // Evaluate all points on every available core
+  std::vector< std::complex<double> > feyn = tri_feyn.eval(s, mRho2, id, sink);
+  delete sink;
+
+  for (int i = 0; i <= Np; i++)
+  {
     std::cout << std::left;
     std::cout << std::setw(7)  << i;
-    std::cout << std::setw(15) << sqrt(si) / mPi;
-    std::cout << std::setw(30) << fx_f;
+    std::cout << std::setw(15) << sqs[i];
+    std::cout << std::setw(30) << feyn[i];
     std::cout << std::endl;
   }
 
-  clock_t end = clock();
-  double elapsed_secs = double(end - begin) / CLOCKS_PER_SEC;
+  auto end = std::chrono::steady_clock::now();
+  double elapsed_secs = std::chrono::duration<double>(end - begin).count();
 
   std::cout << "\nDone in " << elapsed_secs << " seconds. \n";
   std::cout << "\n";
 
   jpacGraph1Dc* plotter = new jpacGraph1Dc();
-  plotter->AddEntry(s, feyn, "feynman");
+  plotter->AddEntry(sqs, feyn, "feynman");
 
   plotter->SetLegend(false);
 
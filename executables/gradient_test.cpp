@@ -0,0 +1,99 @@
+// Test code for the derivatives of the triangle
+//
+// Compares the derivatives in s and t from eval_gradient, for both the feynman
+// and dispersive evaluation, with five-point finite differences of eval
+// at points away from the branch points.
+// The dispersive s-derivative drops the ieps of the values, so it only agrees
+// with their finite differences up to terms of order EPS.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#include "feynman/feynman_triangle.hpp"
+#include "dispersive/dispersive_triangle.hpp"
+#include "quantum_numbers.hpp"
+
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <string>
+
+// Five-point central difference of f at x with step h
+std::complex<double> five_point(std::function<std::complex<double>(double)> f, double x, double h)
+{
+  return (- f(x + 2.*h) + 8. * f(x + h) - 8. * f(x - h) + f(x - 2.*h)) / (12. * h);
+};
+
+// Print the derivatives of one amplitude next to their finite differences
+template<class T>
+void check_gradient(std::string name, T & tri, const std::vector<double> & s, double t, double h)
+{
+  std::cout << "\n" << name << ":\n";
+  std::cout << std::left;
+  std::cout << std::setw(15) << "s/mPi2";
+  std::cout << std::setw(15) << "|ds - fd|";
+  std::cout << std::setw(15) << "ds error";
+  std::cout << std::setw(15) << "|ds|";
+  std::cout << std::setw(15) << "|dt - fd|";
+  std::cout << std::setw(15) << "dt error";
+  std::cout << std::setw(15) << "|dt|" << std::endl;
+
+  for (int i = 0; i < s.size(); i++)
+  {
+    triangle_gradient grad = tri.eval_gradient(s[i], t);
+
+    std::complex<double> fd_s = five_point([&](double x){ return tri.eval(x, t); }, s[i], h);
+    std::complex<double> fd_t = five_point([&](double x){ return tri.eval(s[i], x); }, t, h);
+
+    std::cout << std::setw(15) << s[i] / mPi2;
+    std::cout << std::setw(15) << std::abs(grad.ds - fd_s);
+    std::cout << std::setw(15) << grad.ds_err;
+    std::cout << std::setw(15) << std::abs(grad.ds);
+    std::cout << std::setw(15) << std::abs(grad.dt - fd_t);
+    std::cout << std::setw(15) << grad.dt_err;
+    std::cout << std::setw(15) << std::abs(grad.dt) << std::endl;
+  }
+};
+
+int main( int argc, char** argv )
+{
+  // Desired quantum numbers
+  int id = 0, n = 1;
+
+  // Parse inputs
+  for (int i = 0; i < argc; i++)
+  {
+    if (std::strcmp(argv[i],"-id")==0) id = atoi(argv[i+1]);
+    if (std::strcmp(argv[i],"-n")==0)  n = atoi(argv[i+1]);
+  }
+
+  // All the associated quantum numbers for the amplitude
+  quantum_numbers qns;
+  qns.n = n;
+  qns.set_id(id);
+  qns.mDec = .780; // The decaying particle mass
+
+  // Finite differences need the values to many digits
+  feynman_triangle tri_feyn(&qns, accuracy_policy::publication());
+  dispersive_triangle tri_disp(&qns, accuracy_policy::publication());
+
+  // Below threshold, between threshold and the pseudo-threshold, and above both
+  std::vector<double> s = {1. * mPi2, 10. * mPi2, 30. * mPi2, 60. * mPi2};
+  double h = 1.E-3 * mPi2;
+
+// ---------------------------------------------------------------------------
+// You shouldnt need to change anything below this line
+// ---------------------------------------------------------------------------
+
+  std::cout << "\n";
+  std::cout << "Checking derivatives against five-point finite differences... \n";
+
+  check_gradient("feynman", tri_feyn, s, mRho2, h);
+  check_gradient("dispersive", tri_disp, s, mRho2, h);
+
+  std::cout << "\n";
+
+  return 1.;
+};
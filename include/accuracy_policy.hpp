@@ -0,0 +1,239 @@
+// Settings of the numerical integrations used to evaluate the triangle
+// with named presets trading accuracy for speed.
+//
+// The default constructed policy reproduces the original hard-coded settings:
+// a single 61-point Gauss-Kronrod rule for each dispersive interval, and
+// hcubature with 1e-3 relative tolerance and at most 2E7 evaluations.
+// The dispersion integrals may also use the double exponential rules of boost.
+//
+// The integrals below return whatever the integrand does, std::complex<double>
+// or e.g. the values of several channels together (see channel_values.hpp),
+// which only needs sums, products with doubles, and an abs() for the error tests.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _ACCURACY_
+#define _ACCURACY_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include <boost/math/quadrature/gauss_kronrod.hpp>
+#include <boost/math/quadrature/tanh_sinh.hpp>
+#include <boost/math/quadrature/exp_sinh.hpp>
+
+#include "constants.hpp"
+#include "instrumentation.hpp"
+
+// Quadrature rules available for the dispersion integrals
+enum quadrature_rule
+{
+  kGaussKronrod = 0, // Gauss-Kronrod with the settings below
+  kTanhSinh     = 1, // double exponential for finite (or mapped) intervals
+  kExpSinh      = 2  // double exponential for intervals extending to infinity
+};
+
+struct accuracy_policy
+{
+  // Gauss-Kronrod used for all one-dimensional integrals
+  int    gk_order = 61;   // number of Kronrod points: 15, 21, 31, 41, 51, or 61
+  int    gk_depth = 0;    // maximum number of adaptive bisections
+  double gk_tol   = 1.E-9;
+
+  // Rules of the dispersion integrals between branch points (kGaussKronrod or kTanhSinh)
+  // and of the tail to infinity (any of the three). The double exponential rules
+  // refine until gk_tol is reached and ignore the order and depth
+  quadrature_rule interval_rule = kGaussKronrod;
+  quadrature_rule tail_rule     = kGaussKronrod;
+
+  // hcubature for the two-dimensional Feynman integral
+  double cubature_tol = 1.E-3;
+  int    cubature_max_evals = 2E7;
+
+  // Cheap settings for quickly scanning over parameters
+  static accuracy_policy fast_scan()
+  {
+    accuracy_policy x;
+    x.gk_order = 15; x.gk_depth = 3;  x.gk_tol = 1.E-4;
+    x.cubature_tol = 1.E-2; x.cubature_max_evals = 1E5;
+    return x;
+  };
+
+  // Settings for iterations of a fit
+  static accuracy_policy fit()
+  {
+    accuracy_policy x;
+    x.gk_order = 31; x.gk_depth = 8;  x.gk_tol = 1.E-7;
+    x.cubature_tol = 1.E-3; x.cubature_max_evals = 2E6;
+    return x;
+  };
+
+  // Final results
+  static accuracy_policy publication()
+  {
+    accuracy_policy x;
+    x.gk_order = 61; x.gk_depth = 15; x.gk_tol = 1.E-10;
+    x.cubature_tol = 1.E-5; x.cubature_max_evals = 2E8;
+    return x;
+  };
+};
+
+// ---------------------------------------------------------------------------
+// Type of the values of an integrand f(x)
+template<class F>
+using integrand_value = typename std::decay<decltype(std::declval<F&>()(0.))>::type;
+
+// Whether a value of an integrand is finite
+inline bool all_finite(const std::complex<double> & y)
+{
+  return std::isfinite(std::real(y)) && std::isfinite(std::imag(y));
+};
+
+// ---------------------------------------------------------------------------
+// Bisect [a, b] exactly as gauss_kronrod<double, N>::integrate, counting the
+// final subintervals and the deepest level reached where they are created
+// If edges isnt NULL the upper limit of every final subinterval is appended to it
+template<int N, class F>
+integrand_value<F> gk_bisect(F & f, double a, double b, int levels, double abs_tol, double tol, double & err,
+                             std::vector<double> * edges = NULL, int depth = 0)
+{
+  using boost::math::quadrature::gauss_kronrod;
+  using std::abs;
+
+  double error = 0.;
+  integrand_value<F> estimate = gauss_kronrod<double, N>::integrate(f, a, b, 0, tol, &error);
+
+  double abs_tol1 = abs(estimate * tol);
+  if (abs_tol == 0.) abs_tol = abs_tol1;
+
+  if (levels > 0 && abs_tol1 < error && abs_tol < error)
+  {
+    double mid = (a + b) / 2.;
+    estimate  = gk_bisect<N>(f, a, mid, levels - 1, abs_tol / 2., tol, err, edges, depth + 1);
+    estimate += gk_bisect<N>(f, mid, b, levels - 1, abs_tol / 2., tol, err, edges, depth + 1);
+    return estimate;
+  }
+
+  KT_TALLY(gk_intervals, 1);
+  KT_DEEPEST(gk_depth, depth);
+
+  if (edges != NULL) edges->push_back(b);
+  err += error;
+  return estimate;
+};
+
+// Integrate f from a to b, where b may be infinite, with the N-point rule
+// Infinite upper limits are mapped onto [-1, 1] as in boost
+template<int N, class F>
+integrand_value<F> gk_adaptive(F & f, double a, double b, int levels, double tol, double & err)
+{
+  if (std::isfinite(a) && std::isfinite(b) && a < b) return gk_bisect<N>(f, a, b, levels, 0., tol, err);
+
+  if (std::isfinite(a) && b == std::numeric_limits<double>::infinity())
+  {
+    auto u = [&](double x)
+    {
+      double z = 1. / (x + 1.);
+      return f(2. * z + a - 1.) * z * z;
+    };
+    return 2. * gk_bisect<N>(u, -1., 1., levels, 0., tol, err);
+  }
+
+  // Anything else isnt used here and is left to boost uncounted
+  double error = 0.;
+  integrand_value<F> result = boost::math::quadrature::gauss_kronrod<double, N>::integrate(f, a, b, levels, tol, &error);
+  err += error;
+  return result;
+};
+
+// Integrate f from a to b with the Gauss-Kronrod rule of the policy
+// The estimated error is added to err
+template<class F>
+integrand_value<F> gk_integrate(F f, double a, double b, const accuracy_policy & policy, double & err)
+{
+  double error = 0.;
+  integrand_value<F> result;
+  switch (policy.gk_order)
+  {
+    case 15: result = gk_adaptive<15>(f, a, b, policy.gk_depth, policy.gk_tol, error); break;
+    case 21: result = gk_adaptive<21>(f, a, b, policy.gk_depth, policy.gk_tol, error); break;
+    case 31: result = gk_adaptive<31>(f, a, b, policy.gk_depth, policy.gk_tol, error); break;
+    case 41: result = gk_adaptive<41>(f, a, b, policy.gk_depth, policy.gk_tol, error); break;
+    case 51: result = gk_adaptive<51>(f, a, b, policy.gk_depth, policy.gk_tol, error); break;
+    default: result = gk_adaptive<61>(f, a, b, policy.gk_depth, policy.gk_tol, error); break;
+  }
+
+  err += error;
+  return result;
+};
+
+// ---------------------------------------------------------------------------
+// The double exponential rules sample arbitrarily close to the endpoints, where
+// the mapped integrands vanish but may evaluate to 0 * inf, so such points are dropped.
+// Only within a few ulp of a finite endpoint, or beyond where products of x overflow
+// towards an infinite one, anything else not finite is a real problem and kept
+template<class F>
+struct finite_integrand
+{
+  F & f;
+  double a, b;
+
+  bool near_end(double x, double end) const
+  {
+    if (std::isinf(end)) return std::abs(x) > std::sqrt(std::numeric_limits<double>::max());
+
+    double scale = std::max(std::abs(a), std::abs(b));
+    if (std::isinf(scale)) scale = std::abs(end);
+    return std::abs(x - end) <= 4. * std::numeric_limits<double>::epsilon() * scale;
+  };
+
+  integrand_value<F> operator()(double x) const
+  {
+    integrand_value<F> y = f(x);
+    if (all_finite(y) || !(near_end(x, a) || near_end(x, b))) return y;
+    return integrand_value<F>(0);
+  };
+};
+
+// Integrate f from a to b (which may be infinite) with the tanh-sinh rule
+// The abscissas are computed once per thread and extended as needed
+template<class F>
+integrand_value<F> ts_integrate(F f, double a, double b, const accuracy_policy & policy, double & err)
+{
+  static thread_local boost::math::quadrature::tanh_sinh<double> integrator;
+
+  double error = 0.;
+  size_t levels = 0;
+  finite_integrand<F> g = {f, a, b};
+  integrand_value<F> result = integrator.integrate(g, a, b, policy.gk_tol, &error, (double *) NULL, &levels);
+  KT_TALLY(de_integrals, 1);
+  KT_DEEPEST(de_levels, int(levels));
+
+  err += error;
+  return result;
+};
+
+// Integrate f from a to infinity with the exp-sinh rule
+template<class F>
+integrand_value<F> es_integrate(F f, double a, const accuracy_policy & policy, double & err)
+{
+  static thread_local boost::math::quadrature::exp_sinh<double> integrator;
+
+  double error = 0.;
+  size_t levels = 0;
+  finite_integrand<F> g = {f, a, std::numeric_limits<double>::infinity()};
+  integrand_value<F> result = integrator.integrate(g, a, std::numeric_limits<double>::infinity(), policy.gk_tol, &error, (double *) NULL, &levels);
+  KT_TALLY(de_integrals, 1);
+  KT_DEEPEST(de_levels, int(levels));
+
+  err += error;
+  return result;
+};
+
+#endif
@@ -0,0 +1,176 @@
+// Interpolation of the triangle amplitude as a function of both s and the
+// exchange mass t, precomputed once so fits can replace live integration with
+// a fast lookup.
+//
+// Each axis is split into segments at the points where the amplitude has cusps
+// (threshold, pseudo-thresholds) and nodes are placed in a variable u with
+// x = low + (high - low) (1 - cos(pi u)) / 2 which clusters them at the cusps.
+// Starting from a coarse mesh, intervals on each axis are bisected until cubic
+// interpolation reproduces the midpoints to the requested relative accuracy.
+// All the points of each refinement step are evaluated in parallel.
+//
+// Values are interpolated with bicubic Hermite polynomials in (u_s, u_t) using
+// derivatives precomputed at every node, so a lookup only needs a binary
+// search on each axis and the 16 terms of the Hermite basis.
+//
+// Grids can be saved to a binary file and loaded again with mmap, in which case
+// the values are read directly from the page cache without copying, so loading
+// is almost free and every process on a node shares the same memory.
+// The file is a header (see grid_header below) followed by the segment
+// boundaries and nodes of each axis and then the complex values and
+// derivatives, all in native byte order.
+//
+// Usage: amplitude_grid grid;
+//        grid.build<dispersive_triangle>(qns, s_low, s_high, t_low, t_high);
+//        grid.save("grid.dat");
+//        grid.eval(s, t);
+// and in later jobs: grid.load("grid.dat");
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _AMP_GRID_
+#define _AMP_GRID_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "constants.hpp"
+#include "quantum_numbers.hpp"
+#include "parallel_scan.hpp"
+#include "triangle_error.hpp"
+
+class amplitude_grid
+{
+public:
+  amplitude_grid(){};
+  ~amplitude_grid();
+
+  // Values may point into a mapped file so grids cant be copied
+  amplitude_grid(const amplitude_grid &) = delete;
+  amplitude_grid & operator=(const amplitude_grid &) = delete;
+
+  // Evaluate the amplitude T on the adaptive mesh covering [s_low, s_high] x [t_low, t_high]
+  // options is applied to every amplitude created, e.g. to switch on interpolation
+  // Throws a triangle_error if the range is empty or the channel isnt available
+  template<class T>
+  void build(quantum_numbers qns, double s_low, double s_high, double t_low, double t_high,
+             double tol = 1.E-4, int threads = std::thread::hardware_concurrency(),
+             std::function<void(T&)> options = std::function<void(T&)>())
+  {
+    parallel_scan<T> scan(qns, threads);
+    if (options) scan.set_options(options);
+
+    auto evaluator = [&](const std::vector<scan_point> & points)
+    {
+      return scan.eval(points);
+    };
+
+    build(evaluator, qns, s_low, s_high, t_low, t_high, tol);
+  };
+
+  // Interpolated value at (s, t)
+  // points outside the grid are evaluated at the closest edge
+  // Throws a triangle_error if the grid hasnt been built or loaded
+  std::complex<double> eval(double s, double t);
+
+  // Whether the grid has been built and (s, t) is inside it
+  inline bool in_range(double s, double t)
+  {
+    return (data != NULL) && (s >= s_axis.breaks.front()) && (s <= s_axis.breaks.back())
+                          && (t >= t_axis.breaks.front()) && (t <= t_axis.breaks.back());
+  };
+
+  // Write the grid to file, returns false if it couldnt be written
+  bool save(std::string file);
+
+  // Map a grid saved previously, returns false if the file is missing or incompatible
+  bool load(std::string file);
+
+  // Whether the grid was made for the amplitude with these quantum numbers
+  inline bool matches(quantum_numbers * qns)
+  {
+    return (data != NULL) && (id == qns->id()) && (n == qns->n) && (l == qns->l) && (mDec == qns->mDec);
+  };
+
+  // Number of nodes on each axis
+  inline int s_nodes()
+  {
+    return s_axis.u.size();
+  };
+  inline int t_nodes()
+  {
+    return t_axis.u.size();
+  };
+
+// ---------------------------------------------------------------------------
+private:
+  // Quantum numbers the grid was built for
+  int id = 0, n = 0, l = 0;
+  double mDec = 0., tol = 0.;
+
+  // Layout of the beginning of a saved file
+  struct grid_header
+  {
+    char magic[8];
+    uint32_t version, header_size;
+    int32_t id, n, l, pad;
+    double mDec, tol;
+    int64_t s_breaks, t_breaks, s_nodes, t_nodes;
+  };
+  static const uint32_t version = 1;
+
+  // Nodes along one axis
+  struct grid_axis
+  {
+    std::vector<double> breaks; // segment boundaries
+    std::vector<int> start;     // index of the first node of each segment, and the total
+    std::vector<double> u;      // node positions in the variable u of their segment
+
+    // Value of the variable at position u in segment k
+    double x(int k, double u) const;
+
+    // Cell (index of its first node), local coordinate w in [0,1],
+    // and width h in u of the cell containing x
+    void locate(double x, int & cell, double & w, double & h) const;
+  };
+  grid_axis s_axis, t_axis;
+
+  // Values and derivatives d/du_s, d/du_t, d^2/du_s du_t at every node stored
+  // one after the other, node (i, j) is at i * t_axis.u.size() + j of each block
+  // data points either to storage or to the mapped file
+  std::vector<std::complex<double>> storage;
+  const std::complex<double> * data = NULL;
+
+  // Mapped file
+  const char * map = NULL;
+  size_t map_size = 0;
+  void unmap();
+
+  // Refinement limits
+  int n_init = 8;        // initial intervals per segment
+  int max_nodes = 1024;  // per axis
+  int max_iter = 30;
+  double min_width = 1.E-6; // smallest interval in u
+  double u_min = 1.E-7;     // segment ends are evaluated slightly inside the segment
+
+  // Build using a function which evaluates the amplitude at many points at once
+  void build(std::function<std::vector<std::complex<double>>(const std::vector<scan_point> &)> evaluator,
+             quantum_numbers qns, double s_low, double s_high, double t_low, double t_high, double tol);
+
+  // Derivatives in u at the nodes of each segment of an axis
+  // from values spaced by stride in data
+  static void derivative(const grid_axis & axis, const std::complex<double> * data, int stride, std::complex<double> * result);
+
+  // Cubic Hermite interpolation between two nodes
+  static std::complex<double> hermite(double w, double h, std::complex<double> f0, std::complex<double> d0,
+                                      std::complex<double> f1, std::complex<double> d1);
+};
+
+#endif
@@ -0,0 +1,136 @@
+// Values of several channels at one node of a quadrature, so that they can
+// be integrated together as one vector-valued integrand.
+//
+// The integrals of accuracy_policy.hpp (and boost underneath) only need sums,
+// products with doubles, and an abs(), here the largest modulus of any channel.
+// Error estimates and tests are then the largest of all channels, and the
+// adaptive rules subdivide wherever any channel isnt converged, so every channel
+// is integrated over the same nodes and subintervals.
+// A value without components, such as the 0 boost starts its sums from, acts as zero.
+// Up to max_channels values are kept inline, as they are created and copied
+// many times at every node.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _CHAN_VALUES_
+#define _CHAN_VALUES_
+
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+
+#include "constants.hpp"
+
+struct channel_values
+{
+  // Largest number of channels integrated together
+  static const int max_channels = 8;
+
+  channel_values(int zero = 0)
+  {};
+
+  inline int size() const
+  {
+    return n;
+  };
+
+  inline bool empty() const
+  {
+    return n == 0;
+  };
+
+  // The components are zero until set
+  inline void resize(int x)
+  {
+    for (int i = n; i < x; i++) v[i] = 0.;
+    n = x;
+  };
+
+  inline std::complex<double> & operator[](int i)
+  {
+    return v[i];
+  };
+
+  inline const std::complex<double> & operator[](int i) const
+  {
+    return v[i];
+  };
+
+  inline channel_values & operator+=(const channel_values & x)
+  {
+    if (n == 0) resize(x.n);
+    for (int i = 0; i < x.n; i++) v[i] += x.v[i];
+    return *this;
+  };
+
+  inline channel_values & operator-=(const channel_values & x)
+  {
+    if (n == 0) resize(x.n);
+    for (int i = 0; i < x.n; i++) v[i] -= x.v[i];
+    return *this;
+  };
+
+  inline channel_values & operator*=(double x)
+  {
+    for (int i = 0; i < n; i++) v[i] *= x;
+    return *this;
+  };
+
+private:
+  std::complex<double> v[max_channels];
+  int n = 0;
+};
+
+inline channel_values operator+(channel_values x, const channel_values & y)
+{
+  return x += y;
+};
+
+inline channel_values operator-(channel_values x, const channel_values & y)
+{
+  return x -= y;
+};
+
+inline channel_values operator-(channel_values x)
+{
+  return x *= -1.;
+};
+
+inline channel_values operator*(channel_values x, double y)
+{
+  return x *= y;
+};
+
+inline channel_values operator*(double y, channel_values x)
+{
+  return x *= y;
+};
+
+// Largest modulus of any channel
+inline double abs(const channel_values & x)
+{
+  double result = 0.;
+  for (int i = 0; i < x.size(); i++) result = std::max(result, std::abs(x[i]));
+  return result;
+};
+
+inline bool all_finite(const channel_values & x)
+{
+  for (int i = 0; i < x.size(); i++)
+  {
+    if (!std::isfinite(std::real(x[i])) || !std::isfinite(std::imag(x[i]))) return false;
+  }
+  return true;
+};
+
+// boost prints the value in its error messages
+inline std::ostream & operator<<(std::ostream & out, const channel_values & x)
+{
+  for (int i = 0; i < x.size(); i++) out << ((i > 0) ? " " : "") << x[i];
+  return out;
+};
+
+#endif
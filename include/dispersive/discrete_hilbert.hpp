@@ -0,0 +1,44 @@
+// Discrete Hilbert transform of a function sampled on a uniform grid, i.e.
+// Cauchy integrals int dx f(x) / (x - s) at many points s at once.
+//
+// f is replaced by its piecewise linear interpolant, whose Cauchy integral is
+// known in closed form. Each sample then contributes with the integral of its
+// hat function, which for points s on the same grid only depends on the distance
+// d = (x_j - s) / dx in units of the spacing:
+// w(d) = (d+1) log|d+1| + (d-1) log|d-1| - 2 d log|d|
+// The principal value at the pole is therefore handled analytically and the sum
+// over samples is a discrete convolution done with FFTs, which costs O(M log M)
+// for M samples instead of O(N M) for N points.
+// The function is assumed to vanish at a lower limit (a threshold) that doesnt have
+// to lie on the grid, and the integral stops at the last sample. The samples at
+// either end only have half a hat function and are added separately.
+//
+// The error is second order in the spacing for smooth f and order 3/2 close to
+// square-root branch points.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _DISC_HILB_
+#define _DISC_HILB_
+
+#include <vector>
+
+#include "constants.hpp"
+
+// In-place radix-2 fast fourier transform, the size must be a power of 2
+// The inverse transform includes the 1 / size normalization
+void fft(std::vector<std::complex<double>> & x, bool inverse = false);
+
+// Integral of the hat function of unit width over 1 / (u - d)
+double hat_weight(double d);
+
+// Principal value of int_low^x_high dx f(x) / (x - s) at s_k = x0 + k step dx, k = 0, ..., N-1
+// for f given at the M samples x_j = x0 + j dx, j = j_low, ..., j_low + M - 1,
+// with low <= x_{j_low} the zero of f. The last sample is x_high, above every s_k
+std::vector<std::complex<double>> cauchy_uniform(const std::vector<std::complex<double>> & f, double x0, double dx,
+                                                 int j_low, double low, int step, int N);
+
+#endif
@@ -0,0 +1,112 @@
+// Dispersive evaluation of several spin channels at the same s, t, and decay mass.
+//
+// All channels are integrated together as components of one vector-valued
+// integrand (see channel_values.hpp), so the phase space and kinematics at every
+// quadrature node are only calculated once for all channels (see spectral_samples.hpp)
+// whatever the rules of the accuracy_policy. Adaptive rules subdivide wherever any
+// channel isnt converged, so every channel reaches the tolerance.
+// The dispersion integrals and sum rules are the same as in dispersive_triangle,
+// with the tails mapped according to the slowest falloff of all channels.
+//
+// Usage: dispersive_channels tri(&qns, {0, 1, 10, 11, 20}); tri.eval(s, t);
+// where n, l, and mDec are taken from qns and the spins from each id.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _DISP_CHAN_
+#define _DISP_CHAN_
+
+#include <limits>
+#include <vector>
+
+#include "constants.hpp"
+#include "quantum_numbers.hpp"
+#include "accuracy_policy.hpp"
+#include "channel_values.hpp"
+#include "quadrature_plan.hpp"
+#include "spectral_samples.hpp"
+
+class dispersive_channels
+{
+public:
+  // Throws a triangle_error if any of the channels isnt available, there are more than
+  // channel_values::max_channels, the number of subtractions is negative,
+  // or the policy asks for exp-sinh between branch points
+  dispersive_channels(quantum_numbers * xqn, std::vector<int> xids, accuracy_policy xpol = accuracy_policy());
+  ~dispersive_channels()
+  {
+    clear();
+  };
+
+  // Every channel owns its quantum numbers so these cant be copied
+  dispersive_channels(const dispersive_channels &) = delete;
+  dispersive_channels & operator=(const dispersive_channels &) = delete;
+
+  // Evaluate every channel at fixed CoM energy^2, s, and exchange mass^2, t
+  // in the same order as the ids given at construction
+  std::vector<std::complex<double>> eval(double s, double t);
+
+  // Evaluate every channel on a grid of s with the same t
+  // The sum rules are only calculated once and samples of the spectral functions
+  // are shared between all the points of the grid
+  // result[i][k] is the i-th channel at s[k]
+  std::vector<std::vector<std::complex<double>>> eval(const std::vector<double> & s, double t);
+
+  // Throws a triangle_error if x asks for exp-sinh between branch points
+  void set_policy(accuracy_policy x);
+
+  // see dispersive_triangle::set_partition_reuse
+  inline void set_partition_reuse(bool x)
+  {
+    reuse_partitions = x;
+    clear_partitions();
+  };
+
+  // Largest error estimate over all channels of the last call to eval
+  inline double error()
+  {
+    return err;
+  };
+
+  inline std::vector<int> channels()
+  {
+    return ids;
+  };
+
+private:
+  std::vector<int> ids;
+  std::vector<quantum_numbers*> qns;
+  spectral_samples * samples = NULL;
+  void clear();
+
+  int n, power;
+  accuracy_policy policy;
+  quadrature_plan plan;
+  double err = 0.;
+
+  // Sum rules of every channel, kept until t changes
+  double sr_t = std::numeric_limits<double>::quiet_NaN();
+  std::vector<std::complex<double>> sr;
+  double sr_err = 0.;
+  void sum_rules(double t);
+
+  // Dispersion integrals of every channel at s, the error is added to err
+  std::vector<std::complex<double>> s_dispersion(double s, double t);
+
+  // see dispersive_triangle::set_partition_reuse
+  bool reuse_partitions = false;
+  std::vector<gk_partition> s_partitions, sr_partitions;
+  inline std::vector<gk_partition> * partitions(std::vector<gk_partition> & x)
+  {
+    return (reuse_partitions) ? &x : NULL;
+  };
+  inline void clear_partitions()
+  {
+    s_partitions.clear(); sr_partitions.clear();
+  };
+};
+
+#endif
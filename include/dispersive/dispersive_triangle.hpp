@@ -1,6 +1,22 @@
 // Class to output the evaluation of the triangle diagram using
 // dispersive / spectral function representation.
 //
+// With n = qns->n subtractions at s = 0 the amplitude is
+// s^n / pi * int ds' rho(s') Q(s', t) / (s'^n (s' - s))
+// evaluated as the integral with n + 1 subtractions plus s^n times the sum rule
+// 1 / pi * int ds' rho(s') Q(s', t) / s'^(n+1).
+// More subtractions make the integrand fall off faster at large s',
+// so adaptive accuracy policies need fewer subdivisions of the tail.
+// Without subtractions (n = 0) the sum rule must converge on its own.
+//
+// Both integrals are split at the threshold and pseudo-thresholds of the channel
+// with changes of variables removing the square-root branch points at each
+// (see quadrature_plan.hpp). The remaining tail uses a change of variables
+// matched to the large s' behavior of each integrand (see tail_integral.hpp),
+// given by the growth s'^power of the spectral function of the channel.
+// Gauss-Kronrod or the double exponential rules of boost can be used for either
+// part, selected by the interval_rule and tail_rule of the accuracy_policy.
+//
 // Author:       Daniel Winney (2020)
 // Affiliation:  Joint Physics Analysis Center (JPAC)
 // Email:        dwinney@iu.edu
@@ -9,28 +25,149 @@
 #ifndef _DISP_TRI_
 #define _DISP_TRI_
 
-#include <boost/math/quadrature/gauss_kronrod.hpp>
+#include <limits>
+#include <unordered_map>
+#include <vector>
 
 #include "constants.hpp"
 #include "quantum_numbers.hpp"
+#include "accuracy_policy.hpp"
+#include "triangle_gradient.hpp"
 #include "projection_function.hpp"
+#include "spectral_table.hpp"
+#include "quadrature_plan.hpp"
+#include "discrete_hilbert.hpp"
+#include "result_cache.hpp"
+#include "instrumentation.hpp"
 
 class dispersive_triangle
 {
 public:
-  dispersive_triangle(quantum_numbers * xqn)
-  : qns(xqn), projector(qns), mDec2(xqn->mDec*xqn->mDec)
-  {};
+  // Throws a triangle_error if the channel in xqn isnt available,
+  // the number of subtractions is negative, or the policy asks for exp-sinh
+  // between branch points
+  // The channel may be changed through xqn between calls, after which
+  // evaluating throws a triangle_error if the new one isnt available
+  dispersive_triangle(quantum_numbers * xqn, accuracy_policy xpol = accuracy_policy())
+  : qns(xqn), mDec2(xqn->mDec*xqn->mDec), policy(xpol), projector(qns), plan(xqn->mDec)
+  {
+    check_policy(xpol);
+  };
 
   // Evalate the diagram at fixed CoM energy^2, s, and exchange mass^2, t
   std::complex<double> eval(double s, double t);
 
+  // Evaluate the diagram at many values of s with the same exchange mass t
+  // The s-independent sum rule is only calculated once and samples of the
+  // spectral function are shared between all the points of the grid
+  std::vector<std::complex<double>> eval(const std::vector<double> & s, double t);
+
+  // Evaluate the diagram on the uniform grid s_k = s_low + k (s_high - s_low) / (N - 1)
+  // for a whole lineshape at once. The spectral function is sampled once on a grid
+  // oversample times finer up to twice the largest |s| (or past the last branch point)
+  // and the dispersion integral of its piecewise linear interpolant is evaluated at
+  // every point together as a discrete Hilbert transform (see discrete_hilbert.hpp).
+  // The remaining tail is expanded in powers of s / s', so each term only needs
+  // one integral for all points. The cost is O(M log M) for M samples instead of
+  // O(N M) when integrating point by point, but the accuracy is only second order
+  // in the spacing (3/2 at the branch points), so the spacing has to resolve
+  // the structures of the spectral function.
+  // With an even oversample, error() compares with the result from every other sample
+  // The samples always extend past the last branch point, so a window much narrower
+  // than that needs many more samples than points. If that is more than
+  // uniform_max_ratio times N oversample, the points are evaluated one by one
+  // with eval(std::vector<double>, t) instead.
+  // Throws a triangle_error if N < 2, s_high <= s_low, or oversample < 1
+  std::vector<std::complex<double>> eval_uniform(double s_low, double s_high, int N, double t, int oversample = 4);
+  static const int uniform_max_ratio = 16;
+
+  // Evaluate the diagram at complex s, e.g. for searches of resonance poles
+  // On the first sheet this is the dispersion integral itself. The second sheet
+  // is reached by continuing through the unitarity cut above threshold and
+  // differs by the discontinuity 2i rho(s) Q(s,t) continued to complex s.
+  // The continuation of the spectral function is only reliable close to the
+  // real axis, from below on the second sheet.
+  // Real s (Im s == 0, of either sign) give the same as eval(double, double),
+  // i.e. the limit from above the cut on the first sheet.
+  // Samples of the spectral function on the real axis and the sum rule are
+  // kept between calls with the same t, so each call only costs one pass over
+  // the saved quadrature nodes. Results off the real axis are not saved to the
+  // persistent cache
+  // Throws a triangle_error for the second sheet unless Im s < 0
+  std::complex<double> eval(std::complex<double> s, double t, bool second_sheet = false);
+
+  // Evaluate the diagram along with its derivatives in s and t
+  // The derivatives are integrated with the saved samples of the spectral function
+  // at the same nodes as the amplitude, and the t-derivative of the spectral function
+  // is calculated from the same kinematics at each node
+  // The t-derivative is always calculated directly, even with interpolation
+  // Error estimates of the derivatives are returned alongside, that of the value is in error()
+  // The s-derivative is taken without the ieps of the value, so it differs from finite
+  // differences of eval by terms of order EPS, the same as the value does from the limit
+  triangle_gradient eval_gradient(double s, double t);
+
+  // Replace direct evaluation of the spectral function with an interpolation
+  // table built once for each channel, exchange mass, and decay mass
+  // Channels with 1 / p^2(s) factors (j > 0) have sharp ieps-regulated peaks at the
+  // pseudo-thresholds and are only reproduced to within the noise of those peaks
+  inline void set_interpolation(bool x, double tol = 1.E-6)
+  {
+    interpolate = x; table_tol = tol;
+    table.clear();
+    clear_samples();
+  };
+
+  // Change the rules, depth, and tolerance of the dispersion integrals
+  inline void set_policy(accuracy_policy x)
+  {
+    check_policy(x);
+    policy = x;
+    clear_samples();
+    clear_partitions();
+  };
+
+  // With adaptive policies (gk_depth > 0) start every dispersion integral and
+  // sum rule from the subdivision the previous one converged to, and only
+  // bisect again where it fails the error check (see gk_partition.hpp)
+  // This saves most of the adaptive work when scanning over nearby s or t
+  inline void set_partition_reuse(bool x)
+  {
+    reuse_partitions = x;
+    clear_partitions();
+  };
+
+  // Error estimate achieved by the last call to eval
+  // (the largest over all points if evaluating a grid)
+  inline double error()
+  {
+    return err;
+  };
+
+  // Integrand calls and timings of the last call to eval
+  // only filled if compiled with KT_INSTRUMENT
+  inline eval_stats stats()
+  {
+    return info;
+  };
+
+  // Consult a persistent cache of results before integrating
+  // and save any new results to it
+  inline void set_cache(result_cache * x)
+  {
+    cache_file = x;
+  };
+
 // ---------------------------------------------------------------------------
 private:
   // All the associated quantum numbers and parameters for the amplitude
   quantum_numbers * qns;
   double mDec2;
 
+  // Settings of the integration and accumulated error estimate
+  accuracy_policy policy;
+  double err = 0.;
+  void check_policy(const accuracy_policy & x);
+
   double s, t;
   void fix_energies(double xs, double xt)
   {
@@ -38,16 +175,106 @@ private:
   };
 
   // Two-body phase space
-  std::complex<double> rho(double s);
+  std::complex<double> rho(std::complex<double> s);
 
   // Q-function
   projection_function projector;
 
+  // rho(s) Q(s,t) grows as s^power() at large s
+  // Read from qns every time like everything else depending on the channel,
+  // so changing its id between calls evaluates the new channel
+  inline int power()
+  {
+    return get_spectral_power(qns->id()) + qns->l;
+  };
+
+  // The spectral function rho(s) * Q(s,t) entering the dispersion integrals
+  std::complex<double> spectral(double s);
+
+  // Analytically continued to complex s
+  std::complex<double> spectral(std::complex<double> s);
+
+  // Derivative with respect to t
+  std::complex<double> spectral_dt(double s);
+
+  // When evaluating many values of s at fixed t, samples of the spectral function
+  // at quadrature nodes are saved since they are the same for every point
+  // as is the sum rule. Both are kept until t changes
+  bool use_cache = false;
+  std::unordered_map<double, std::complex<double>> cache;
+  double cache_t = std::numeric_limits<double>::quiet_NaN();
+  int cache_n = -1, cache_l = -1, cache_id = 0;
+  std::complex<double> cache_sr;
+  double cache_sr_err = 0.;
+  void reuse_samples(double t);
+  inline void clear_samples()
+  {
+    cache.clear(); dt_cache.clear();
+    cache_t = std::numeric_limits<double>::quiet_NaN();
+  };
+
+  // Same for the derivatives in t, only filled when evaluating gradients
+  std::unordered_map<double, std::complex<double>> dt_cache;
+  bool cache_has_dt = false;
+  std::complex<double> cache_sr_dt;
+  double cache_sr_dt_err = 0.;
+
+  // Interpolation table of the spectral function up to table_max
+  // above which the spectral function is always evaluated directly
+  bool interpolate = false;
+  double table_tol, table_max = 100.;
+  spectral_table table;
+  void update_table();
+
+  // Instrumentation
+  eval_stats info;
+
+  // Persistent result cache
+  result_cache * cache_file = NULL;
+  // The quadrature rules are folded into the order, and anything else changing
+  // the results of the dispersion integrals increases the revision below
+  inline cache_key key(double xs, double xt)
+  {
+    int order = policy.gk_order + 100 * policy.interval_rule + 1000 * policy.tail_rule;
+    return cache_key(qns, interpolate ? kInterpolated : kDispersive, xs, xt,
+                     interpolate ? table_tol : policy.gk_tol, order, policy.gk_depth, revision);
+  };
+
+  // Revision of the dispersion integrals for the cache
+  // 1: tails mapped with their large-s falloff
+  // 2: integrals split at every branch point of the channel
+  // 3: tails mapped including the growth with l
+  static const int revision = 3;
+
   // Calculation of dispersion integrals
-  double exc = 0.; // small interval around pseudo-threshold to exclude
-  std::complex<double> s_dispersion(double low, double high);
-  
+  // Breakpoints of the integrals for the decay mass at construction
+  quadrature_plan plan;
+  std::complex<double> s_dispersion();
+
+  // Subdivisions of every interval of the plan from the last dispersion integral
+  // and sum rule, only used if reuse_partitions
+  bool reuse_partitions = false;
+  std::vector<gk_partition> s_partitions, sr_partitions;
+  inline std::vector<gk_partition> * partitions(std::vector<gk_partition> & x)
+  {
+    return (reuse_partitions) ? &x : NULL;
+  };
+  inline void clear_partitions()
+  {
+    s_partitions.clear(); sr_partitions.clear();
+  };
+
+  // Same at complex s, where the integrand has no singularity on the real axis
+  std::complex<double> s_dispersion(std::complex<double> s, std::complex<double> spec_s);
+
+  // Derivatives of s_dispersion in s and t at real s
+  void s_dispersion_gradient(std::complex<double> & ds, std::complex<double> & dt, double & ds_err, double & dt_err);
+
+  // int ds' rho(s') Q(s', t) / s'^(n+1)
   std::complex<double> sum_rule();
+  std::complex<double> sum_rule_dt();
+  double sr_err = 0.;    // error estimate of the last sum rule
+  double sr_dt_err = 0.; // and of its t-derivative
 };
 
 #endif
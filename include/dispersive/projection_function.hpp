@@ -10,46 +10,90 @@
 
 #include "constants.hpp"
 #include "quantum_numbers.hpp"
+#include "spin_channels.hpp"
 
 std::complex<double> Kallen(std::complex<double> x, std::complex<double> y, std::complex<double> z);
 
+// Kinematic quantities at fixed s and t entering the projection,
+// each only calculated once
+// s may be complex, in which case everything is continued with the principal
+// branches of the square roots and logs. This matches the values on the real
+// axis above threshold when approached from below (Im s < 0)
+struct kinematics
+{
+  kinematics(std::complex<double> xs, double xt, double xmDec2);
+
+  std::complex<double> s;
+  double t, mDec2;
+
+  // (sqrt(s) +- mPi)^2 - mDec^2 - ieps
+  std::complex<double> pplus, pminus;
+
+  // Breakup momenta squared
+  std::complex<double> psqr, qsqr;
+
+  // Kacser function analytically continues momenta between s and t channels
+  std::complex<double> kacser;
+
+  // Complex bounds of integration
+  std::complex<double> t_minus, t_plus;
+
+  // Lowest angular kernel function
+  std::complex<double> Q_0;
+
+  // Q_k for k = first, ..., first + number - 1 from the recurrence
+  // Q_k = t Q_{k-1} - (t_plus^k - t_minus^k) / (k Kacser)
+  // and optionally their derivatives with respect to t
+  void Q(int first, int number, std::complex<double> * result, std::complex<double> * dt = NULL) const;
+  std::complex<double> Q(int k) const;
+
+  // Ratio of agular momentum barrier factors that are removed when partial wave projecting
+  // 1 / p^2(s)
+  std::complex<double> barrier_ratio(int ell) const;
+};
+
 class projection_function
 {
 public:
   projection_function(quantum_numbers * xqn)
   : qns(xqn), mDec2(xqn->mDec*xqn->mDec)
-  {};
+  {
+    set_kernel();
+  };
 
   // Evalate the diagram at fixed CoM energy^2, s, and exchange mass^2, t
+  // Throws a triangle_error if the channel in qns was changed to one that isnt available
   std::complex<double> eval(double s, double t);
 
+  // Analytic continuation to complex s
+  std::complex<double> eval(std::complex<double> s, double t);
+
+  // Same but with kinematics already calculated
+  std::complex<double> eval(const kinematics & kin);
+
+  // Value and derivative with respect to t sharing the same kinematics
+  void eval(const kinematics & kin, std::complex<double> & value, std::complex<double> & dt);
+
 private:
   quantum_numbers * qns;
   double mDec2;
 
-  // Save s and t so dont need to pass them around
-  double s, t;
-  void set_energies(double xs, double xt)
+  // Evaluation specialized at compile time for each channel, so the number of Q's
+  // is a constant and the kernel is inlined. The one for the channel in qns is
+  // picked at construction, and again if the id in qns has changed since.
+  // If dt isnt NULL it is filled with the t-derivative
+  typedef std::complex<double> (projection_function::*evaluator)(const kinematics & kin, std::complex<double> * dt);
+  evaluator evaluate;
+  int kernel_id;
+  void set_kernel();
+  inline evaluator kernel()
   {
-      s = xs; t = xt;
+    if (qns->id() != kernel_id) set_kernel();
+    return evaluate;
   };
 
-  // Kacser function analytically continues momenta between s and t channels
-  std::complex<double> Kacser();
-  std::complex<double> psqr();
-  std::complex<double> qsqr();
-
-  // Complex bounds of integtion
-  std::complex<double> t_minus();
-  std::complex<double> t_plus();
-
-  // Ratio of momenta q(s) / p(s)
-  std::complex<double> barrier_ratio(int ell);
-
-  // Angular kernel functions
-  std::complex<double> Q_0();
-  std::complex<double> Q(int n);
-
+  template<int ID>
+  std::complex<double> evaluate_channel(const kinematics & kin, std::complex<double> * dt);
 };
 
 #endif
@@ -0,0 +1,89 @@
+// Breakpoints and changes of variables for the dispersion integrals over s'.
+//
+// The spectral function has square-root branch points at threshold 4 mPi^2
+// and at the two pseudo-thresholds (mDec -+ mPi)^2. The integrals are split at
+// each of these and every finite interval is integrated in the variable u with
+// s' = low + (high - low) (1 - cos(pi u)) / 2, as in spectral_table, which removes
+// the square-root behavior at both ends. Past the last branch point one more
+// interval of the same width is done this way before the remaining tail is
+// mapped according to its falloff (see tail_integral.hpp).
+// The subdivisions of adaptive policies can be kept between calls in gk_partitions.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _QUAD_PLAN_
+#define _QUAD_PLAN_
+
+#include <algorithm>
+#include <vector>
+
+#include "constants.hpp"
+#include "accuracy_policy.hpp"
+#include "gk_partition.hpp"
+#include "tail_integral.hpp"
+
+// Integrate f from a to b with square-root branch points at both ends
+// with the interval rule of the policy
+// If given, the Gauss-Kronrod subdivision in u is reused and saved in partition
+template<class F>
+integrand_value<F> branch_integrate(F f, double a, double b, const accuracy_policy & policy, double & err, gk_partition * partition = NULL)
+{
+  auto mapped = [&](double u)
+  {
+    double x = a + (b - a) * (1. - cos(M_PI * u)) / 2.;
+    return f(x) * ((b - a) * M_PI * sin(M_PI * u) / 2.);
+  };
+
+  if (policy.interval_rule == kTanhSinh) return ts_integrate(mapped, 0., 1., policy, err);
+
+  return gk_integrate(mapped, 0., 1., policy, err, partition);
+};
+
+struct quadrature_plan
+{
+  // Breakpoints for a decay of mass mDec
+  quadrature_plan(double mDec)
+  {
+    points = {sthPi, (mDec - mPi) * (mDec - mPi), (mDec + mPi) * (mDec + mPi)};
+
+    std::sort(points.begin(), points.end());
+    points.erase(std::unique(points.begin(), points.end()), points.end());
+    points.erase(std::remove_if(points.begin(), points.end(),
+                 [](double x){ return x < sthPi; }), points.end());
+    if (points.size() == 1) points.push_back(2. * sthPi);
+
+    // one more interval past the last branch point before the tail
+    points.push_back(2. * points.back() - points[points.size() - 2]);
+  };
+
+  // Finite breakpoints in increasing order, the last is the start of the tail
+  std::vector<double> points;
+
+  // Integrate f from threshold to infinity for f falling off as x^-p
+  // With partitions, the subdivision of every interval and the tail is reused
+  // from and saved to the corresponding entry (see gk_partition.hpp)
+  template<class F>
+  integrand_value<F> integrate(F f, double p, const accuracy_policy & policy, double & err,
+                               std::vector<gk_partition> * partitions = NULL) const
+  {
+    if (partitions != NULL) partitions->resize(points.size());
+    auto partition = [&](int i)
+    {
+      return (partitions == NULL) ? NULL : &(*partitions)[i];
+    };
+
+    integrand_value<F> result(0);
+    for (int i = 0; i < points.size() - 1; i++)
+    {
+      result += branch_integrate(f, points[i], points[i+1], policy, err, partition(i));
+    }
+    result += tail_integrate(f, points.back(), p, policy, err, partition(points.size() - 1));
+
+    return result;
+  };
+};
+
+#endif
@@ -0,0 +1,58 @@
+// Samples of the spectral functions rho(s) Q_{jj'}(s,t) of several channels
+// with the same subtractions and decay mass, evaluated together.
+//
+// At each s the phase space and every kinematic quantity of the projection
+// (breakup momenta, Kacser function, endpoints t_minus and t_plus, and Q_0)
+// are only calculated once and shared between all channels.
+// Samples are saved until t changes (or clear is called), so integrals
+// over the same nodes at different s only calculate them once.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _SPEC_SAMPLES_
+#define _SPEC_SAMPLES_
+
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "constants.hpp"
+#include "quantum_numbers.hpp"
+#include "projection_function.hpp"
+
+class spectral_samples
+{
+public:
+  // One channel for each entry of qns, all with the same n, l, and mDec
+  // Throws a triangle_error if any channel isnt available
+  spectral_samples(std::vector<quantum_numbers*> qns);
+
+  // Spectral functions of every channel at s, in the same order as at construction
+  const std::complex<double> * at(double s, double t);
+
+  // Largest power of s with which any of the spectral functions grows,
+  // including the growth with l
+  inline int power()
+  {
+    return max_power;
+  };
+
+  inline void clear()
+  {
+    samples.clear();
+    samples_t = std::numeric_limits<double>::quiet_NaN();
+  };
+
+private:
+  double mDec2;
+  int max_power;
+  std::vector<projection_function> projectors;
+
+  double samples_t = std::numeric_limits<double>::quiet_NaN();
+  std::unordered_map<double, std::vector<std::complex<double>>> samples;
+};
+
+#endif
@@ -0,0 +1,99 @@
+// Interpolation table for the spectral function rho(s) * Q(s,t) so that the
+// dispersion integrals dont need to evaluate the complex logs and square roots
+// at every quadrature node.
+//
+// Between each pair of breakpoints (thresholds and pseudo-thresholds) nodes are
+// placed adaptively in a variable u with s = low + (high - low) (1 - cos(pi u)) / 2
+// which removes the square-root behavior at both ends. Values are then
+// interpolated with a natural cubic spline in u.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _SPEC_TABLE_
+#define _SPEC_TABLE_
+
+#include <functional>
+#include <vector>
+#include <map>
+
+#include "constants.hpp"
+
+class spectral_table
+{
+public:
+  spectral_table(){};
+
+  // Tabulate the function f between the sorted breakpoints in points
+  // to a relative accuracy tol. Values below ~1.E-8 are below the numerical noise
+  // of the ieps prescription near the pseudo-thresholds
+  void build(std::function<std::complex<double>(double)> f, std::vector<double> points, double tol = 1.E-6);
+
+  // Interpolated value at s
+  std::complex<double> eval(double s);
+
+  // Whether the table has been built and s is inside the tabulated range
+  inline bool in_range(double s)
+  {
+    return !segments.empty() && (s >= segments.front().low) && (s <= segments.back().high);
+  };
+
+  // Tables are built for a fixed channel, number of t subtractions (which
+  // enters the projection through Q_l and 1/t^l), exchange mass, and decay mass
+  inline void set_key(int xid, int xl, double xt, double xmDec)
+  {
+    id = xid; l = xl; t = xt; mDec = xmDec;
+  };
+  inline bool matches(int xid, int xl, double xt, double xmDec)
+  {
+    return !segments.empty() && (id == xid) && (l == xl) && (t == xt) && (mDec == xmDec);
+  };
+
+  // Total number of nodes in the table
+  int size();
+
+  inline void clear()
+  {
+    segments.clear();
+  };
+
+private:
+  int id = 0, l = 0;
+  double t = 0., mDec = 0.;
+
+  // Interpolation between two adjacent breakpoints
+  struct segment
+  {
+    double low, high;
+    std::vector<double> u;
+    std::vector<std::complex<double>> f, d2f; // values and second derivatives
+  };
+  std::vector<segment> segments;
+
+  // Map between s and the interpolation variable u in [0,1]
+  inline double s_of_u(const segment & seg, double u)
+  {
+    return seg.low + (seg.high - seg.low) * (1. - cos(M_PI * u)) / 2.;
+  };
+  inline double u_of_s(const segment & seg, double s)
+  {
+    return acos(1. - 2. * (s - seg.low) / (seg.high - seg.low)) / M_PI;
+  };
+
+  // Recursively bisect [u0, u1] until a quadratic reproduces the quarter points
+  // with a maximum depth and number of nodes per segment
+  int max_depth = 24;
+  int max_nodes = 50000;
+  double rel_tol = 1.E-6;
+  void refine(const segment & seg, std::function<std::complex<double>(double)> & f,
+              double u0, std::complex<double> f0, double u1, std::complex<double> f1,
+              std::complex<double> fm, double abs_tol, int depth,
+              std::map<double, std::complex<double>> & nodes);
+
+  // Second derivatives for a natural cubic spline through the nodes of seg
+  void spline(segment & seg);
+};
+
+#endif
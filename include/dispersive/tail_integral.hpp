@@ -0,0 +1,57 @@
+// Integration of the dispersion integrals from a finite point to infinity.
+//
+// Each integrand falls off at large s' as a known power s'^-p (up to logs)
+// fixed by the channel and number of subtractions. Instead of the generic
+// mapping boost uses for infinite intervals, the tail is mapped onto w in (0, 1]
+// with s' = low w^(-3 / (p - 1)), in which the integrand vanishes like w^2 (up to logs)
+// at w = 0, so the logarithms in the asymptotic behavior are suppressed and a
+// single fixed Gauss-Kronrod rule is usually enough. Compared to the default
+// mapping this is most important for integrands falling only as s'^-2 log(s').
+// The policy may instead pick tanh-sinh on the same mapping, or exp-sinh on the
+// unmapped tail, which handles the slow falloff by itself.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _TAIL_INT_
+#define _TAIL_INT_
+
+#include <limits>
+
+#include "constants.hpp"
+#include "accuracy_policy.hpp"
+#include "gk_partition.hpp"
+
+// Integrate f from low > 0 to infinity for f falling off as x^-p
+// Integrals that dont converge fast enough to be mapped (p <= 1.5)
+// are left to the default mapping
+// If given, the subdivision of the mapped interval is reused and saved in partition
+// With the exp-sinh rule the tail isnt mapped at all
+template<class F>
+integrand_value<F> tail_integrate(F f, double low, double p, const accuracy_policy & policy, double & err, gk_partition * partition = NULL)
+{
+  double infty = std::numeric_limits<double>::infinity();
+
+  if (policy.tail_rule == kExpSinh) return es_integrate(f, low, policy, err);
+
+  if (p <= 1.5 || low <= 0.)
+  {
+    if (policy.tail_rule == kTanhSinh) return ts_integrate(f, low, infty, policy, err);
+    return gk_integrate(f, low, infty, policy, err);
+  }
+
+  double a = 3. / (p - 1.);
+  auto mapped = [&](double w)
+  {
+    double x = low * pow(w, -a);
+    return f(x) * (a * x / w);
+  };
+
+  if (policy.tail_rule == kTanhSinh) return ts_integrate(mapped, 0., 1., policy, err);
+
+  return gk_integrate(mapped, 0., 1., policy, err, partition);
+};
+
+#endif
@@ -10,57 +10,125 @@
 #ifndef _INTEGRAND_
 #define _INTEGRAND_
 
+#include <algorithm>
+#include <vector>
+
 #include "constants.hpp"
 #include "quantum_numbers.hpp"
+#include "spin_channels.hpp"
 
 class dF3_integrand
 {
 public:
   dF3_integrand(quantum_numbers* xqns)
   : qns(xqns), mDec2(xqns->mDec * xqns->mDec)
-  {};
+  {
+    set_kernel();
+  };
 
   // Evaluate the feynman parameters
   std::complex<double> eval(double x, double y, double z);
 
+  // Evaluate a block of npt sets of feynman parameters at once.
+  // Inputs and outputs are stored as separate arrays (structure of arrays)
+  // and real and imaginary parts are returned separately
+  void eval(int npt, const double * x, const double * y, const double * z, double * re, double * im);
+
+  // Same along with the derivatives of the integrand with respect to s and t.
+  // For the i-th point out[6*i], ..., out[6*i+5] are the real and imaginary parts
+  // of the value, d/ds, and d/dt as expected by hcubature with fdim = 6
+  void gradient(int npt, const double * x, const double * y, const double * z, double * out);
+
+  // Evaluate several channels with the same n, l, and mDec as qns but the spins
+  // given by ids, sharing the denominators and dimensionally regularized
+  // integrals between all of them. Throws a triangle_error if any isnt available
+  void set_channels(const std::vector<int> & ids);
+
+  // Evaluate all channels set above for a block of points.
+  // For the i-th point out[2*nch*i + 2*c] and out[2*nch*i + 2*c + 1] are the real
+  // and imaginary parts of the c-th channel, as expected by hcubature with fdim = 2*nch
+  void eval_channels(int npt, const double * x, const double * y, const double * z, double * out);
+
+  inline int channels()
+  {
+    return kernels.size();
+  };
+
+  // Coefficient of s^k in the Taylor expansion of the unsubtracted integrand
+  // around s = 0 for a block of points. With n > 1 subtractions, eval only
+  // subtracts the k = 0 term and the integrals of k = 1, ..., n-1 have to be
+  // subtracted from the result times s^k
+  // If dt is true the derivative of the coefficient with respect to t is returned instead
+  void taylor(int npt, const double * x, const double * y, const double * z, int k, double * re, double * im, bool dt = false);
+
+  // Evaluate the integrand at fixed x already integrated over y from 0 to 1 - x
+  // The y integral is done in closed form using that the denominators are
+  // quadratic in y and the kernels are polynomials of at most cubic order
+  std::complex<double> eval_inner(double x);
+
+  // Same along with the derivatives with respect to s and t
+  std::complex<double> eval_inner(double x, std::complex<double> & ds, std::complex<double> & dt);
+
   // Fix the energies s and t
+  // The kernel is picked again if the id in qns has changed since the last time
+  // Throws a triangle_error if it was changed to a channel that isnt available
   inline void set_energies(double xs, double xt)
   {
     s = xs; t = xt;
+    if (qns->id() != kernel_id) set_kernel();
   };
 
 private:
   // All the associated quantum numbers and parameters for the amplitude
   quantum_numbers* qns;
 
-  double denom, delta;
-  double denom0, delta0;
   double mDec2;
   double s, t; // center of mass energies, t is the exchange particle mass
 
-  // Currently stored feynman parameters
-  double x, y ,z;
-  inline void update_fparams(double xx, double yy, double zz)
-  {
-    // Save the feynman parameters so we dont have to keep passing them
-    x = xx; y = yy; z = zz;
+  // Dimensionally regularized integrals of divergence order 0 and 1 are
+  // T(0) = 1 / (denom - ieps) and T(1) = 2 log(denom - ieps)
+  // with denom the combined denominators of all the propagators.
+  // Every kernel is then of the form A * T(1) + B * T(0) with real
+  // coefficients A and B depending on the feynman parameters.
+  // Buffers for a block of points:
+  std::vector<double> denom, delta, A, B;
 
-    // Update the denominators
-    denom0 = z*t + (1.-z)*mPi2 - x*z*mDec2 - y*z* mPi2;
+  // T(0) and T(1) for a block of points shared between channels,
+  // real and imaginary parts of both for each point
+  std::vector<double> T;
 
-    // update P's
-    delta0 = x*(1.-z)*mDec2 + y*(1.-z)*mPi2;
-  };
+  // Add sign * mT for a block of points to re and im
+  // The triangle kernels are reparameterized in terms of the shifted loop
+  // momentum relevant for the triangle
+  void mT(int npt, const double * x, const double * y, const double * z, double _s, double sign, double * re, double * im);
+
+  // Add sign * mT of every channel in kernels in the layout of eval_channels() to out
+  void mT_channels(int npt, const double * x, const double * y, const double * z, double _s, double sign, double * out);
+
+  // Add sign * mT and its derivatives in the layout of gradient() to out
+  // The s-derivative is only added if with_ds (i.e. not for the subtraction at s = 0)
+  void mT_gradient(int npt, const double * x, const double * y, const double * z, double _s, double sign, bool with_ds, double * out);
+
+  // Derivatives of the coefficients A and B with respect to s (through delta as well)
+  // The kernels are at most quadratic in s so a central difference is exact
+  void kernel_ds(int npt, const double * x, const double * y, const double * z, double _s, double * dA, double * dB);
+
+  // Closed form of the y integral of mT at fixed x
+  // and optionally its derivatives with respect to s and t
+  std::complex<double> mT_inner(double x, double _s, std::complex<double> * ds = NULL, std::complex<double> * dt = NULL);
 
-  // Dimensionally regularized integrals
-  // denom is the combined denominators of all the propagators
-  // ell is the degree of divergence
-  std::complex<double> T(int ell);
+  // Moments int_0^1 dw w^m / (w - rho) and their derivatives with respect to rho
+  std::complex<double> J(int m, std::complex<double> rho);
+  std::complex<double> dJ(int m, std::complex<double> rho);
 
-  // The dimensionally regularized integrals but reparameterized
-  // in terms of the shifted loop momentum relevant for the triangle
-  std::complex<double> mT(int id, double _s);
+  // Kernel giving the coefficients A and B for the channel in qns
+  // and the id it was picked for
+  feynman_kernel kernel;
+  int kernel_id;
+  void set_kernel();
 
+  // Kernels of the channels evaluated together by eval_channels
+  std::vector<feynman_kernel> kernels;
 };
 
 #endif
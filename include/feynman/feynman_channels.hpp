@@ -0,0 +1,99 @@
+// Feynman evaluation of several spin channels at the same s, t, and decay mass.
+//
+// All channels are integrated together as components of one vector-valued
+// integrand, so the feynman parameters, combined denominators, and the
+// dimensionally regularized integrals are only calculated once per node.
+// The cubature only stops once every channel is converged.
+//
+// Usage: feynman_channels tri(&qns, {0, 1, 10, 11, 20}); tri.eval(s, t);
+// where n, l, and mDec are taken from qns and the spins from each id.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _FEYN_CHAN_
+#define _FEYN_CHAN_
+
+#include "cubature.h"
+#include <vector>
+
+#include "constants.hpp"
+#include "quantum_numbers.hpp"
+#include "accuracy_policy.hpp"
+#include "instrumentation.hpp"
+#include "feynman/dF3_integrand.hpp"
+#include "feynman/feynman_triangle.hpp"
+
+class feynman_channels
+{
+public:
+  // Throws a triangle_error if any of the channels isnt available
+  feynman_channels(quantum_numbers * xqn, std::vector<int> xids, accuracy_policy xpol = accuracy_policy());
+  ~feynman_channels()
+  {
+    clear();
+  };
+
+  // Every channel owns its amplitude so these cant be copied
+  feynman_channels(const feynman_channels &) = delete;
+  feynman_channels & operator=(const feynman_channels &) = delete;
+
+  // Evaluate every channel at fixed CoM energy^2, s, and exchange mass^2, t
+  // in the same order as the ids given at construction
+  std::vector<std::complex<double>> eval(double s, double t);
+
+  // Evaluate every channel on a grid of s with the same t
+  // result[i][k] is the i-th channel at s[k]
+  std::vector<std::vector<std::complex<double>>> eval(const std::vector<double> & s, double t);
+
+  inline void set_policy(accuracy_policy x)
+  {
+    policy = x;
+    for (int i = 0; i < amps.size(); i++) amps[i]->set_policy(x);
+  };
+
+  // Largest error estimate over all channels of the last call to eval
+  inline double error()
+  {
+    return err;
+  };
+
+  // Integrand calls and timings of the last call to eval
+  // only filled if compiled with KT_INSTRUMENT
+  inline eval_stats stats()
+  {
+    return info;
+  };
+
+  inline std::vector<int> channels()
+  {
+    return ids;
+  };
+
+private:
+  std::vector<int> ids;
+  std::vector<quantum_numbers*> qns;
+
+  // Single channel amplitudes only used for the Taylor polynomials with n > 1
+  std::vector<feynman_triangle*> amps;
+  void clear();
+
+  // Integrand of all channels together
+  dF3_integrand * integrand = NULL;
+
+  accuracy_policy policy;
+  double err = 0.;
+
+  // Instrumentation
+  eval_stats info;
+
+  // Feynman parameters and values of the integrand for a block of points
+  std::vector<double> x, y, z, out;
+
+  // Wrapper for interfacing the integrand with the vectorized hcubature routine
+  static int wrapped_integrand(unsigned ndim, size_t npt, const double *in, void *fdata, unsigned fdim, double *fval);
+};
+
+#endif
@@ -10,21 +10,81 @@
 #define _FEYN_TRI_
 
 #include "cubature.h"
+#include <algorithm>
+#include <vector>
 
 #include "constants.hpp"
 #include "quantum_numbers.hpp"
+#include "accuracy_policy.hpp"
+#include "triangle_gradient.hpp"
+#include "result_cache.hpp"
+#include "instrumentation.hpp"
 #include "feynman/dF3_integrand.hpp"
 
 class feynman_triangle
 {
 public:
-  feynman_triangle(quantum_numbers * xqn)
-  : qns(xqn), integrand(qns)
+  // Throws a triangle_error if the channel in xqn isnt available
+  // or the number of subtractions is negative
+  feynman_triangle(quantum_numbers * xqn, accuracy_policy xpol = accuracy_policy())
+  : qns(xqn), integrand(qns), policy(xpol)
   {};
 
   // Evalate the diagram at fixed CoM energy^2, s, and exchange mass^2, t
   std::complex<double> eval(double s, double t);
 
+  // Evaluate the diagram at many values of s with the same exchange mass t
+  std::vector<std::complex<double>> eval(const std::vector<double> & s, double t);
+
+  // Evaluate the diagram along with its derivatives in s and t
+  // The derivatives are integrated in the same pass as the amplitude, as extra
+  // components of the hcubature integrand or from the same nodes in x if analytic
+  // Their error estimates are returned alongside, that of the value is in error()
+  triangle_gradient eval_gradient(double s, double t);
+
+  // Sum of the integrals of the Taylor coefficients k = 1, ..., n-1 of the
+  // integrand around s = 0 times s^k, which eval subtracts for n > 1 subtractions
+  // The coefficients only depend on t and are saved between calls
+  std::complex<double> taylor_polynomial(double s, double t, double * error = NULL);
+
+  // Do the integral over one feynman parameter in closed form so that only
+  // a one-dimensional adaptive integral remains
+  // This is always adaptive, with at least analytic_depth bisections even if the
+  // policy has none, to the relative tolerance gk_tol of the policy
+  inline void set_analytic(bool x)
+  {
+    analytic = x;
+  };
+
+  // Change the tolerance and maximum number of evaluations of the integration
+  // The Taylor coefficients were integrated with the old policy and are redone
+  inline void set_policy(accuracy_policy x)
+  {
+    policy = x;
+    taylor_n = -1;
+  };
+
+  // Error estimate achieved by the last call to eval
+  // (the largest over all points if evaluating a grid)
+  inline double error()
+  {
+    return err;
+  };
+
+  // Integrand calls and timings of the last call to eval
+  // only filled if compiled with KT_INSTRUMENT
+  inline eval_stats stats()
+  {
+    return info;
+  };
+
+  // Consult a persistent cache of results before integrating
+  // and save any new results to it
+  inline void set_cache(result_cache * x)
+  {
+    cache = x;
+  };
+
 // ---------------------------------------------------------------------------
 private:
   // All the associated quantum numbers and parameters for the amplitude
@@ -33,8 +93,69 @@ private:
   // Feynman parameter integrand
   dF3_integrand integrand;
 
-  // Wrapper for interfacing the integrand with hcubature routine
-  static int wrapped_integrand(unsigned ndim, const double *in, void *fdata, unsigned fdim, double *fval);
+  // Settings of the integration and error estimate of the last result
+  accuracy_policy policy;
+  double err = 0.;
+
+  // Whether to integrate over y analytically
+  bool analytic = false;
+  static const int analytic_depth = 15;
+  inline accuracy_policy analytic_policy()
+  {
+    accuracy_policy x = policy;
+    x.gk_depth = std::max(x.gk_depth, int(analytic_depth));
+    return x;
+  };
+  std::complex<double> eval_analytic();
+  std::complex<double> eval_cubature();
+  triangle_gradient gradient_analytic();
+  triangle_gradient gradient_cubature();
+
+  // With n > 1 subtractions the integrand only subtracts the value at s = 0,
+  // the integrals of the remaining Taylor coefficients c_k, k = 1, ..., n-1,
+  // only depend on t and are saved here between calls
+  // and their derivatives in t if needed for the gradient
+  std::vector<std::complex<double>> taylor, taylor_dt;
+  double taylor_t = 0., taylor_err = 0., taylor_dt_err = 0.;
+  int taylor_n = -1, taylor_l = -1, taylor_id = 0;
+  void set_taylor(double t, bool dt = false);
+  inline bool taylor_saved(double t)
+  {
+    return taylor_n == qns->n && taylor_l == qns->l && taylor_id == qns->id() && taylor_t == t;
+  };
+
+  // Instrumentation
+  eval_stats info;
+
+  // Persistent result cache
+  result_cache * cache = NULL;
+  // With n > 1 the Taylor coefficients are integrated with the Gauss-Kronrod
+  // settings of the policy, so these are folded into the order (and sub_tol) as well
+  inline cache_key key(double s, double t)
+  {
+    int taylor_order = (qns->n > 1) ? policy.gk_order + 100 * policy.gk_depth : 0;
+    if (analytic)
+    {
+      int order = (qns->n > 1) ? taylor_order : policy.gk_order;
+      return cache_key(qns, kFeynman1D, s, t, policy.gk_tol, order, analytic_policy().gk_depth, revision);
+    }
+    return cache_key(qns, kFeynman2D, s, t, policy.cubature_tol, taylor_order, policy.cubature_max_evals,
+                     revision, (qns->n > 1) ? policy.gk_tol : 0.);
+  };
+
+  // Revision of the Feynman integrals for the cache
+  // 1: Taylor coefficients for n > 1 integrated with the policy
+  static const int revision = 1;
+
+  // Feynman parameters and values of the integrand for a block of points
+  std::vector<double> x, y, z, re, im, grad;
+
+  // Wrapper for interfacing the integrand with the vectorized hcubature routine
+  // which passes many points at a time
+  static int wrapped_integrand(unsigned ndim, size_t npt, const double *in, void *fdata, unsigned fdim, double *fval);
+
+  // Same with the derivatives in s and t as four more components
+  static int wrapped_gradient(unsigned ndim, size_t npt, const double *in, void *fdata, unsigned fdim, double *fval);
 };
 
 #endif
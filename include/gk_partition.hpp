@@ -0,0 +1,114 @@
+// Adaptive Gauss-Kronrod integration remembering where it subdivided.
+//
+// The adaptive gauss_kronrod of boost starts the bisection from scratch on every
+// call even though, when the same integral is evaluated for many nearby
+// parameters (e.g. a dense scan in s), the subdivision it converges to barely
+// changes. Here the subintervals of the last adaptive integration are saved in a
+// gk_partition and the next call first applies the fixed composite rule on them.
+// The Kronrod - Gauss difference on each subinterval comes for free and serves as
+// the check: only if the summed error exceeds the tolerance (or twice the error
+// the adaptive integration achieved on the same partition) is the bisection
+// run again and the partition replaced.
+//
+// The bisection (gk_bisect in accuracy_policy.hpp) follows the same criterion
+// as boost, so recording a partition gives the same result as gk_integrate without one.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _GK_PART_
+#define _GK_PART_
+
+#include <vector>
+
+#include "constants.hpp"
+#include "accuracy_policy.hpp"
+
+struct gk_partition
+{
+  // Boundaries of the subintervals from the lower to the upper limit
+  // empty until the first adaptive integration
+  std::vector<double> edges;
+
+  // Summed error estimate of the adaptive integration, the rule it used
+  // and the deepest level of its bisection
+  double error = 0.;
+  int order = 0, depth = 0;
+
+  inline void clear()
+  {
+    edges.clear(); error = 0.; order = 0; depth = 0;
+  };
+};
+
+// ---------------------------------------------------------------------------
+// Try the saved partition first and only bisect again if it fails the check
+template<int N, class F>
+integrand_value<F> gk_reuse(F & f, double a, double b, const accuracy_policy & policy, double & err, gk_partition & partition)
+{
+  using boost::math::quadrature::gauss_kronrod;
+  using std::abs;
+
+  integrand_value<F> result(0);
+  double error = 0.;
+
+  if (partition.order == N && partition.edges.size() > 1
+      && partition.edges.front() == a && partition.edges.back() == b)
+  {
+    for (int i = 0; i < partition.edges.size() - 1; i++)
+    {
+      double e = 0.;
+      result += gauss_kronrod<double, N>::integrate(f, partition.edges[i], partition.edges[i+1], 0, policy.gk_tol, &e);
+      error  += e;
+    }
+
+    if (error <= std::max(policy.gk_tol * abs(result), 2. * partition.error))
+    {
+      KT_TALLY(gk_intervals, long(partition.edges.size()) - 1);
+      KT_DEEPEST(gk_depth, partition.depth);
+      err += error;
+      return result;
+    }
+  }
+
+  error = 0.;
+  partition.edges.assign(1, a);
+  result = gk_bisect<N>(f, a, b, policy.gk_depth, 0., policy.gk_tol, error, &partition.edges);
+  partition.error = error;
+  partition.order = N;
+
+  // Bisection halves the interval at every level
+  double smallest = b - a;
+  for (int i = 0; i < partition.edges.size() - 1; i++) smallest = std::min(smallest, partition.edges[i+1] - partition.edges[i]);
+  partition.depth = int(round(log2((b - a) / smallest)));
+
+  err += error;
+  return result;
+};
+
+// ---------------------------------------------------------------------------
+// Same as gk_integrate in accuracy_policy.hpp but reusing and updating the partition
+// Without adaptivity (gk_depth = 0), a partition, or for infinite limits
+// this is the same as gk_integrate
+template<class F>
+integrand_value<F> gk_integrate(F f, double a, double b, const accuracy_policy & policy, double & err, gk_partition * partition)
+{
+  if (partition == NULL || policy.gk_depth == 0 || !std::isfinite(a) || !std::isfinite(b))
+  {
+    return gk_integrate(f, a, b, policy, err);
+  }
+
+  switch (policy.gk_order)
+  {
+    case 15: return gk_reuse<15>(f, a, b, policy, err, *partition);
+    case 21: return gk_reuse<21>(f, a, b, policy, err, *partition);
+    case 31: return gk_reuse<31>(f, a, b, policy, err, *partition);
+    case 41: return gk_reuse<41>(f, a, b, policy, err, *partition);
+    case 51: return gk_reuse<51>(f, a, b, policy, err, *partition);
+    default: return gk_reuse<61>(f, a, b, policy, err, *partition);
+  }
+};
+
+#endif
@@ -0,0 +1,118 @@
+// Opt-in counters and timers for the integrations inside each evaluation.
+// These are only compiled in when KT_INSTRUMENT is defined
+// (cmake -DINSTRUMENT=ON), otherwise the macros below do nothing and all
+// the counters stay zero.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _INSTRUMENT_
+#define _INSTRUMENT_
+
+#include <algorithm>
+#include <chrono>
+
+// Statistics of the last call to eval
+struct eval_stats
+{
+  // Number of integrand evaluations
+  long feynman_calls = 0;    // dF3_integrand (points in x, y or only x if analytic)
+  long dispersion_calls = 0; // s_dispersion
+  long sum_rule_calls = 0;   // sum_rule
+
+  // Number of batches of points requested by hcubature_v
+  long cubature_batches = 0;
+
+  // Regions of the 2D hcubature rule, counted from the 17 points each region
+  // is evaluated with in every batch. hcubature doesnt expose its depth
+  long cubature_regions = 0;
+
+  // Final subintervals of all Gauss-Kronrod integrals (including reused
+  // partitions) and the deepest level of bisection of any of them
+  long gk_intervals = 0;
+  int  gk_depth = 0;
+
+  // Number of tanh-sinh and exp-sinh integrals and the most levels
+  // of refinement any of them needed
+  long de_integrals = 0;
+  int  de_levels = 0;
+
+  // Time spent in each phase in ms
+  double feynman_time = 0., dispersion_time = 0., sum_rule_time = 0., table_time = 0.;
+
+  // Total number of integrand calls
+  inline long calls()
+  {
+    return feynman_calls + dispersion_calls + sum_rule_calls;
+  };
+
+  inline void reset()
+  {
+    *this = eval_stats();
+  };
+};
+
+// The one-dimensional integrators dont know which amplitude called them
+// and count into the stats of the innermost eval running on this thread
+inline eval_stats * & active_stats()
+{
+  static thread_local eval_stats * x = NULL;
+  return x;
+};
+
+// Makes stats the active ones until the end of the scope
+class stats_scope
+{
+public:
+  stats_scope(eval_stats & stats)
+  : previous(active_stats())
+  {
+    active_stats() = &stats;
+  };
+
+  ~stats_scope()
+  {
+    active_stats() = previous;
+  };
+
+private:
+  eval_stats * previous;
+};
+
+// Adds the time between construction and destruction to a counter in ms
+class phase_timer
+{
+public:
+  phase_timer(double & xtotal)
+  : total(xtotal), start(std::chrono::steady_clock::now())
+  {};
+
+  ~phase_timer()
+  {
+    total += 1.E3 * std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  };
+
+private:
+  double & total;
+  std::chrono::steady_clock::time_point start;
+};
+
+// KT_RESET clears the stats and makes them active for the rest of the scope
+// KT_TALLY and KT_DEEPEST add to and take the maximum of a field of the active stats
+#ifdef KT_INSTRUMENT
+  #define KT_COUNT(counter, n)  (counter) += (n)
+  #define KT_TIME(total)        phase_timer _kt_timer_(total)
+  #define KT_RESET(stats)       (stats).reset(); stats_scope _kt_scope_(stats)
+  #define KT_TALLY(field, n)    if (active_stats() != NULL) active_stats()->field += (n)
+  #define KT_DEEPEST(field, n)  if (active_stats() != NULL) active_stats()->field = std::max(active_stats()->field, (n))
+#else
+  #define KT_COUNT(counter, n)
+  #define KT_TIME(total)
+  #define KT_RESET(stats)
+  #define KT_TALLY(field, n)
+  #define KT_DEEPEST(field, n)
+#endif
+
+#endif
@@ -0,0 +1,200 @@
+// Driver to evaluate triangle amplitudes on a grid of points using all cores.
+//
+// The triangle classes save intermediate values (s, t, feynman parameters, ...)
+// as members and so a single object cannot be shared between threads.
+// Instead every thread builds its own amplitude for each channel it encounters
+// and points are handed out dynamically in chunks which shrink as the scan
+// nears completion, so expensive points (e.g. near thresholds) dont leave
+// cores idle.
+//
+// Usage: parallel_scan<feynman_triangle> scan(qns); scan.eval(points);
+// or scan.eval(points, &sink) to also stream the results to a result_sink
+// where T is any class with a constructor T(quantum_numbers*) and a
+// method eval(double s, double t).
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _PAR_SCAN_
+#define _PAR_SCAN_
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "constants.hpp"
+#include "quantum_numbers.hpp"
+#include "spin_channels.hpp"
+#include "result_sink.hpp"
+
+template<class T>
+class parallel_scan
+{
+public:
+  // n, l, and mDec are taken from xqns, the channel id from each scan_point
+  parallel_scan(quantum_numbers xqns, int xthreads = std::thread::hardware_concurrency())
+  : base(xqns), nthreads((xthreads > 0) ? xthreads : 1)
+  {};
+
+  // Optional function applied to every amplitude a thread creates
+  // e.g. to switch on interpolation
+  inline void set_options(std::function<void(T&)> f)
+  {
+    options = f;
+  };
+
+  // Evaluate every point, results are returned in the same order
+  // Every channel is checked before starting any threads and a triangle_error
+  // is thrown if any isnt available. If an amplitude throws during the scan,
+  // the other threads stop after their current point and the first exception
+  // is rethrown here
+  std::vector<std::complex<double>> eval(const std::vector<scan_point> & points)
+  {
+    return eval(points, NULL);
+  };
+
+  // Same but every result is also written to the sink as soon as its done.
+  // Points the sink already has from a previous run are not evaluated again,
+  // a triangle_error is thrown if these dont match the points given
+  std::vector<std::complex<double>> eval(const std::vector<scan_point> & points, result_sink * sink)
+  {
+    std::set<int> ids;
+    for (int i = 0; i < points.size(); i++) ids.insert(points[i].id);
+    for (auto id = ids.begin(); id != ids.end(); ++id)
+    {
+      quantum_numbers qns = base;
+      qns.set_id(*id);
+      check_channel(&qns);
+    }
+
+    std::vector<std::complex<double>> result(points.size());
+    std::vector<bool> done(points.size(), false);
+    if (sink != NULL)
+    {
+      const std::map<int, scan_result> & previous = sink->previous();
+      for (auto x = previous.begin(); x != previous.end(); ++x)
+      {
+        int i = x->first;
+        const scan_point & p = x->second.point;
+        if (i < 0 || i >= points.size() || p.s != points[i].s || p.t != points[i].t || p.id != points[i].id)
+        {
+          throw triangle_error("parallel_scan::eval", "point " + std::to_string(i) + " in the sink belongs to a different scan");
+        }
+        result[i] = x->second.value;
+        done[i] = true;
+      }
+    }
+
+    scan_state state;
+
+    std::vector<std::thread> pool;
+    for (int i = 0; i < nthreads; i++)
+    {
+      pool.push_back(std::thread(&parallel_scan::work, this, std::cref(points), std::cref(done), sink,
+                                 std::ref(result), std::ref(state)));
+    }
+    for (int i = 0; i < nthreads; i++) pool[i].join();
+
+    // Whatever finished is saved before passing on a failure
+    // which is the first one, even if saving fails too
+    if (sink != NULL)
+    {
+      try
+      {
+        sink->flush();
+      }
+      catch (...)
+      {
+        if (!state.error) throw;
+      }
+    }
+    if (state.error) std::rethrow_exception(state.error);
+
+    return result;
+  };
+
+  // Convinence for a scan in s with fixed t and id
+  std::vector<std::complex<double>> eval(const std::vector<double> & s, double t, int id, result_sink * sink = NULL)
+  {
+    std::vector<scan_point> points;
+    for (int i = 0; i < s.size(); i++) points.push_back({s[i], t, id});
+    return eval(points, sink);
+  };
+
+private:
+  quantum_numbers base;
+  int nthreads;
+  std::function<void(T&)> options;
+
+  // Smallest number of points taken at once
+  int min_chunk = 1;
+
+  // Shared between the threads of one scan: the next point to hand out
+  // and the first exception thrown by any of them
+  struct scan_state
+  {
+    std::atomic<int> next{0};
+    std::atomic<bool> stop{false};
+    std::exception_ptr error;
+    std::mutex mtx;
+  };
+
+  // Each thread takes chunks of the remaining points until there are none left
+  void work(const std::vector<scan_point> & points, const std::vector<bool> & done, result_sink * sink,
+            std::vector<std::complex<double>> & result, scan_state & state)
+  {
+    // Amplitudes (and their quantum numbers) belonging to this thread
+    std::map<int, quantum_numbers> qns;
+    std::map<int, T*> amps;
+
+    int N = points.size();
+    try
+    {
+      while (!state.stop)
+      {
+        // Chunk size proportional to the remaining work
+        int remaining = N - state.next.load();
+        int chunk = std::max(min_chunk, remaining / (4 * nthreads));
+
+        int start = state.next.fetch_add(chunk);
+        if (start >= N) break;
+        int end = std::min(N, start + chunk);
+
+        for (int i = start; i < end && !state.stop; i++)
+        {
+          if (done[i]) continue;
+
+          int id = points[i].id;
+          if (amps.find(id) == amps.end())
+          {
+            qns[id] = base;
+            qns[id].set_id(id);
+            amps[id] = new T(&qns[id]);
+            if (options) options(*amps[id]);
+          }
+
+          result[i] = amps[id]->eval(points[i].s, points[i].t);
+          if (sink != NULL) sink->write(i, points[i], result[i]);
+        }
+      }
+    }
+    catch (...)
+    {
+      // An exception escaping the thread would terminate the program
+      std::lock_guard<std::mutex> lock(state.mtx);
+      if (!state.error) state.error = std::current_exception();
+      state.stop = true;
+    }
+
+    for (auto amp = amps.begin(); amp != amps.end(); ++amp) delete amp->second;
+  };
+};
+
+#endif
@@ -0,0 +1,103 @@
+// Persistent cache of evaluated triangle amplitudes so the same points dont
+// have to be recalculated between fit iterations or different jobs.
+//
+// The cache is a binary file of fixed size records, each containing every
+// parameter the result depends on (channel, subtractions, masses, s, t,
+// method/tolerance of the integration, and revision of the algorithm) along
+// with the result.
+// The file is memory-mapped for reading and indexed by a hash of the parameters.
+// New results are only ever appended under an exclusive file lock, so many
+// processes (and threads) may read and write the same file at once.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _RES_CACHE_
+#define _RES_CACHE_
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "constants.hpp"
+#include "quantum_numbers.hpp"
+
+// Identifiers for the different methods of evaluating the triangle
+enum cache_method
+{
+  kDispersive   = 0,
+  kInterpolated = 1,
+  kFeynman2D    = 2,
+  kFeynman1D    = 3
+};
+
+// Everything a cached value depends on
+// order and limit are the quadrature rule and its maximum depth / evaluations
+// sub_tol is the tolerance of any other integrals entering the result, or 0
+// revision is increased whenever a change of a method alters its results,
+// so values stored by older versions are no longer found
+struct cache_key
+{
+  int32_t id, n, l, method, order, limit, revision;
+  double mDec, s, t, tol, sub_tol;
+
+  cache_key(quantum_numbers * qns, int xmethod, double xs, double xt, double xtol, int xorder, int xlimit,
+            int xrevision = 0, double xsub_tol = 0.)
+  : id(qns->id()), n(qns->n), l(qns->l), method(xmethod), order(xorder), limit(xlimit), revision(xrevision),
+    mDec(qns->mDec), s(xs), t(xt), tol(xtol), sub_tol(xsub_tol)
+  {};
+
+  uint64_t hash() const;
+};
+
+class result_cache
+{
+public:
+  // Open (or create) the cache file
+  result_cache(std::string file);
+  ~result_cache();
+
+  // Look up a value and its error estimate, returns false if not in the cache
+  bool find(const cache_key & key, std::complex<double> & value, double * error = NULL);
+
+  // Append a new value to the file
+  void store(const cache_key & key, std::complex<double> value, double error = 0.);
+
+  // Number of records currently indexed
+  int size();
+
+private:
+  std::string filename;
+  int fd = -1;
+
+  // Layout of the file: a header followed by records
+  struct header
+  {
+    char magic[8];
+    uint32_t version, record_size;
+  };
+  struct record
+  {
+    uint64_t hash;
+    int32_t id, n, l, method, order, limit, revision;
+    double mDec, s, t, tol, sub_tol;
+    double re, im, error;
+  };
+  static const uint32_t version = 4;
+
+  // Read-only mapping of the file and index of the hashes to records
+  const char * map = NULL;
+  size_t map_size = 0, n_indexed = 0;
+  std::unordered_multimap<uint64_t, size_t> index;
+
+  // Re-map the file if other writers have appended to it
+  void refresh();
+
+  // Threads share one cache
+  std::mutex mtx;
+};
+
+#endif
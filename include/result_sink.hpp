@@ -0,0 +1,221 @@
+// Destinations for the results of a scan which are written as soon as each
+// point is evaluated, so a crashed or killed scan keeps everything done so far.
+//
+// Points may arrive in any order and from many threads at once. Each is tagged
+// with its index in the scan and buffered in memory, and the buffer is written
+// out every flush_points results or flush_seconds seconds (and when the sink is
+// closed or destroyed). Reopening an existing file reads back the points already
+// on disk (dropping a partially written last record), which parallel_scan then
+// skips, so a scan can be resumed simply by running it again with the same file.
+// The settings of the scan (see scan_config) are saved at the start of the file
+// and a file written with different ones is refused instead of resumed.
+// Failing to write the results throws a triangle_error, which parallel_scan
+// passes on from the thread writing them.
+//
+// Backends:
+//  csv_sink    text file with a line of the settings, a header line, and
+//              one line "index,id,s,t,re,im" per point
+//  binary_sink header with the settings followed by fixed size records
+//              (see binary_sink::record) in native byte order
+//  plot_sink   collects the points in memory (optionally passing them on to
+//              another sink) and hands them, ordered by index, to a plotting
+//              function when closed, e.g. to fill a jpacGraph1Dc
+//
+// Usage: csv_sink out("scan.csv", scan_config(qns, kDispersive, policy.gk_tol));
+//        parallel_scan<dispersive_triangle> scan(qns); scan.eval(points, &out);
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _RES_SINK_
+#define _RES_SINK_
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "constants.hpp"
+#include "quantum_numbers.hpp"
+#include "result_cache.hpp"
+#include "triangle_error.hpp"
+
+// A single point in a scan
+struct scan_point
+{
+  double s, t;
+  int id;
+};
+
+// Settings the results of a scan depend on besides the points themselves
+// method is one of the cache_method identifiers (see result_cache.hpp)
+// and tol the tolerance of its integration
+struct scan_config
+{
+  double mDec = 0., tol = 0.;
+  int32_t n = 0, l = 0, method = 0;
+
+  scan_config(){};
+
+  scan_config(const quantum_numbers & qns, int xmethod, double xtol)
+  : mDec(qns.mDec), tol(xtol), n(qns.n), l(qns.l), method(xmethod)
+  {};
+
+  inline bool operator==(const scan_config & x) const
+  {
+    return (mDec == x.mDec) && (tol == x.tol) && (n == x.n) && (l == x.l) && (method == x.method);
+  };
+};
+
+// The result of a single point of a scan
+struct scan_result
+{
+  int index;
+  scan_point point;
+  std::complex<double> value;
+};
+
+class result_sink
+{
+public:
+  virtual ~result_sink(){};
+
+  // Save the result of the index-th point, safe to call from many threads
+  void write(int index, const scan_point & point, std::complex<double> value);
+
+  // Write out everything buffered so far
+  void flush();
+
+  // Flush and write anything left, e.g. the plot of a plot_sink
+  // Called by the destructors of the backends but may be called earlier
+  virtual void close()
+  {
+    flush();
+  };
+
+  // Results of a previous run found when opening the sink, by index
+  inline const std::map<int, scan_result> & previous()
+  {
+    return loaded;
+  };
+
+  inline bool done(int index)
+  {
+    return loaded.find(index) != loaded.end();
+  };
+
+  // How often the buffer is written out
+  inline void set_flush(int points, double seconds)
+  {
+    flush_points = points; flush_seconds = seconds;
+  };
+
+protected:
+  // Write a block of results to the backend and make sure they reach the file
+  // Throws a triangle_error if they dont
+  virtual void write_block(const std::vector<scan_result> & block) = 0;
+
+  std::map<int, scan_result> loaded;
+
+private:
+  std::mutex mtx;
+  std::vector<scan_result> buffer;
+  int flush_points = 100;
+  double flush_seconds = 10.;
+  std::chrono::steady_clock::time_point last_flush = std::chrono::steady_clock::now();
+
+  // flush with mtx already locked
+  void flush_locked();
+};
+
+// ---------------------------------------------------------------------------
+// Comma separated values with a line of the settings and a header line
+// Throws a triangle_error if the file cant be opened or was written with other settings
+class csv_sink : public result_sink
+{
+public:
+  csv_sink(std::string file, scan_config xconfig);
+  ~csv_sink();
+
+  void close();
+
+protected:
+  void write_block(const std::vector<scan_result> & block);
+
+private:
+  std::string filename;
+  scan_config config;
+  FILE * out = NULL;
+};
+
+// ---------------------------------------------------------------------------
+// Binary file of fixed size records
+// Throws a triangle_error if the file cant be opened, isnt a file of records,
+// or was written with other settings
+class binary_sink : public result_sink
+{
+public:
+  binary_sink(std::string file, scan_config xconfig);
+  ~binary_sink();
+
+  void close();
+
+  // The file starts with a header followed by one record per point
+  struct header
+  {
+    char magic[8];
+    uint32_t version, record_size;
+    double mDec, tol;
+    int32_t n, l, method, unused;
+  };
+  struct record
+  {
+    int32_t index, id;
+    double s, t, re, im;
+  };
+
+protected:
+  void write_block(const std::vector<scan_result> & block);
+
+private:
+  std::string filename;
+  scan_config config;
+  FILE * out = NULL;
+  static const uint32_t version = 2;
+};
+
+// ---------------------------------------------------------------------------
+// Adapter for plotting the results at the end of a scan
+// The plotting function receives every result of this and any previous run
+// of the inner sink, ordered by index. The inner sink has to outlive this one
+class plot_sink : public result_sink
+{
+public:
+  plot_sink(std::function<void(const std::vector<scan_result> &)> xplot, result_sink * xinner = NULL)
+  : plot(xplot), inner(xinner)
+  {
+    if (inner != NULL) loaded = inner->previous();
+    results = loaded;
+  };
+
+  ~plot_sink();
+
+  void close();
+
+protected:
+  void write_block(const std::vector<scan_result> & block);
+
+private:
+  std::function<void(const std::vector<scan_result> &)> plot;
+  result_sink * inner;
+  std::map<int, scan_result> results;
+  bool plotted = false;
+};
+
+#endif
@@ -0,0 +1,191 @@
+// Triangle with an exchanged resonance of finite width.
+//
+// Instead of a fixed exchange mass t, the triangle is averaged over the
+// spectral density of the exchanged particle, taken from the discontinuity
+// of any lefthand_cut (e.g. a breit_wigner):
+//
+//    T(s) = int dt' disc(t') T(s, t') / int dt' disc(t')
+//
+// between t_low and t_high. Rather than doing a nested integral for every s,
+// the amplitude is only evaluated on a fixed set of t-slices (Chebyshev nodes)
+// and interpolated in between with a polynomial. The integrals of the spectral
+// density against each interpolating polynomial do not depend on s and are
+// calculated once, so each evaluation costs n fixed-mass evaluations per panel.
+// Each slice keeps its own amplitude so anything they save between calls
+// (e.g. interpolation tables of the spectral function) is reused.
+//
+// The amplitude is only smooth in t above (mDec - mPi)^2, below which the
+// exchanged particle can be produced on-shell in the decay. If the range
+// crosses this point it is split into two panels with separate polynomials,
+// but convergence in the lower panel is much slower.
+//
+// Usage: smeared_triangle<dispersive_triangle> tri(&qns, &bw, t_low, t_high);
+// where T is any class with a constructor T(quantum_numbers*) and methods
+// eval(double s, double t) and eval(std::vector<double> s, double t).
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _SMEAR_TRI_
+#define _SMEAR_TRI_
+
+#include <boost/math/quadrature/gauss_kronrod.hpp>
+#include <functional>
+#include <vector>
+
+#include "constants.hpp"
+#include "quantum_numbers.hpp"
+#include "lefthand_cut.hpp"
+#include "triangle_error.hpp"
+
+template<class T>
+class smeared_triangle
+{
+public:
+  // Throws a triangle_error for an empty range, vanishing spectral density,
+  // or if the fixed-mass amplitude cant be built
+  smeared_triangle(quantum_numbers * xqn, lefthand_cut * xexchange, double xlow, double xhigh, int xn = 10)
+  : qns(xqn), exchange(xexchange), t_low(xlow), t_high(xhigh), n((xn > 1) ? xn : 2)
+  {
+    if (t_high <= t_low)
+    {
+      throw triangle_error("smeared_triangle", "t_high must be larger than t_low");
+    }
+
+    set_slices();
+  };
+
+  ~smeared_triangle()
+  {
+    for (int k = 0; k < amps.size(); k++) delete amps[k];
+  };
+
+  // Each slice owns its amplitude so smeared triangles cant be copied
+  smeared_triangle(const smeared_triangle &) = delete;
+  smeared_triangle & operator=(const smeared_triangle &) = delete;
+
+  // Optional function applied to the amplitude of every slice
+  // e.g. to switch on interpolation
+  inline void set_options(std::function<void(T&)> f)
+  {
+    for (int k = 0; k < amps.size(); k++) f(*amps[k]);
+  };
+
+  // Evaluate the smeared triangle at fixed CoM energy^2, s
+  std::complex<double> eval(double s)
+  {
+    std::complex<double> result = 0.;
+    for (int k = 0; k < amps.size(); k++)
+    {
+      result += weights[k] * amps[k]->eval(s, t[k]);
+    }
+
+    return result;
+  };
+
+  // Evaluate a whole grid of s at once, slice by slice
+  std::vector<std::complex<double>> eval(const std::vector<double> & s)
+  {
+    std::vector<std::complex<double>> result(s.size(), 0.);
+    for (int k = 0; k < amps.size(); k++)
+    {
+      std::vector<std::complex<double>> slice = amps[k]->eval(s, t[k]);
+      for (int i = 0; i < s.size(); i++) result[i] += weights[k] * slice[i];
+    }
+
+    return result;
+  };
+
+  // Exchange masses of the slices and their weights
+  inline std::vector<double> slices()
+  {
+    return t;
+  };
+  inline std::vector<double> slice_weights()
+  {
+    return weights;
+  };
+
+// ---------------------------------------------------------------------------
+private:
+  quantum_numbers * qns;
+  lefthand_cut * exchange;
+
+  // Range of exchange masses and number of slices per panel
+  double t_low, t_high;
+  int n;
+
+  // Exchange masses, weights, and amplitudes of each slice
+  std::vector<double> t, weights;
+  std::vector<T*> amps;
+
+  // Barycentric weights of the interpolating polynomial
+  std::vector<double> lambda;
+
+  // Value of the k-th Lagrange polynomial through the n slices
+  // of the panel starting at slice p
+  double lagrange(int p, int k, double tp)
+  {
+    double sum = 0.;
+    for (int j = p; j < p + n; j++)
+    {
+      if (tp == t[j]) return (j == k) ? 1. : 0.;
+      sum += lambda[j] / (tp - t[j]);
+    }
+
+    return lambda[k] / (tp - t[k]) / sum;
+  };
+
+  // Place the slices at Chebyshev nodes in each panel and integrate the
+  // spectral density against each Lagrange polynomial
+  void set_slices()
+  {
+    auto density = [&](double tp)
+    {
+      return std::real(exchange->disc(tp));
+    };
+
+    double norm;
+    norm = boost::math::quadrature::gauss_kronrod<double, 61>::integrate(density, t_low, t_high, 15, 1.E-10, NULL);
+    if (std::abs(norm) < 1.E-15)
+    {
+      throw triangle_error("smeared_triangle", "spectral density vanishes between t_low and t_high");
+    }
+
+    // Split at the point where the amplitude stops being smooth in t
+    std::vector<double> panels = {t_low};
+    double t_sing = (qns->mDec - mPi) * (qns->mDec - mPi);
+    if (t_sing > t_low && t_sing < t_high) panels.push_back(t_sing);
+    panels.push_back(t_high);
+
+    for (int i = 0; i < panels.size() - 1; i++)
+    {
+      double low = panels[i], high = panels[i+1];
+
+      int p = t.size();
+      for (int k = 0; k < n; k++)
+      {
+        double theta = M_PI * (2.*k + 1.) / (2.*n);
+        t.push_back((low + high) / 2. - (high - low) * cos(theta) / 2.);
+        lambda.push_back(((k % 2 == 0) ? 1. : -1.) * sin(theta));
+        amps.push_back(new T(qns));
+      }
+
+      for (int k = p; k < p + n; k++)
+      {
+        auto dt = [&](double tp)
+        {
+          return density(tp) * lagrange(p, k, tp);
+        };
+
+        double w;
+        w = boost::math::quadrature::gauss_kronrod<double, 61>::integrate(dt, low, high, 15, 1.E-10, NULL);
+        weights.push_back(w / norm);
+      }
+    }
+  };
+};
+
+#endif
@@ -0,0 +1,246 @@
+// Kernels for each available combination of spins, specialized at compile time
+// so the inner loops of the integrations contain no branching on the channel.
+//
+// Each channel with code ID = quantum_numbers::id() defines:
+//  - nQ, the number of angular functions Q_{l}, Q_{l+1}, ... needed
+//  - power, such that rho(s) Q_{jj'}(s,t) grows as s^power (up to logs) at large s
+//    for l = 0, each unit of l adds one to it
+//  - projection(), Q_{jj'}(s,t) in terms of the Q_{l+k} for the dispersive evaluation
+//  - feynman(), coefficients A and B of the Feynman kernel A * T(1) + B * T(0)
+//
+// projection_function instantiates its whole evaluation for every channel, so the
+// projection kernels are inlined at each node of the dispersion integrals.
+// get_feynman_kernel maps a runtime id to the pre-instantiated Feynman kernels,
+// which each fill a whole block of points, and is called only once per amplitude
+// after check_channel has made sure the channel exists.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _CHANNELS_
+#define _CHANNELS_
+
+#include "constants.hpp"
+#include "quantum_numbers.hpp"
+#include "triangle_error.hpp"
+
+// Everything the dispersive kernels need at fixed s and t
+// Most Q's any projection kernel may use
+const int max_nQ = 8;
+
+struct projection_inputs
+{
+  std::complex<double> s; // complex when continuing away from the real axis
+  double mDec2;
+  std::complex<double> Q[max_nQ];  // Q_{l}, Q_{l+1}, ...
+  std::complex<double> psqr, qsqr; // breakup momenta squared
+};
+
+// Signatures of the kernels
+typedef std::complex<double> (*projection_kernel)(const projection_inputs &);
+typedef void (*feynman_kernel)(int npt, const double * z, const double * delta, double s, double mDec2, double * A, double * B);
+
+// Return the kernels for channel id or NULL if not available
+projection_kernel get_projection_kernel(int id);
+feynman_kernel    get_feynman_kernel(int id);
+int               get_projection_nQ(int id);
+int               get_spectral_power(int id);
+
+// Whether channel id is available in both the dispersive and Feynman representations
+bool channel_available(int id);
+
+// Throw a triangle_error if an amplitude with these quantum numbers cant be evaluated
+void check_channel(quantum_numbers * qns);
+
+// ---------------------------------------------------------------------------
+// Projection of z^2 onto the Q's, shared by the d-wave and omega cases
+inline std::complex<double> z2_moment(const projection_inputs & in)
+{
+  std::complex<double> s = in.s;
+  double mDec2 = in.mDec2;
+
+  std::complex<double> result;
+  result  = 4.* in.Q[2];
+  result += (4. * s - 4. * mDec2 - 12. * mPi2) * in.Q[1];
+  result += (s*s - 2.*mDec2*s + mDec2*mDec2 - 6.*mPi2*s + 6.*mPi2*mDec2 + 9.*mPi2*mPi2) * in.Q[0];
+  return result;
+};
+
+template<int ID>
+struct spin_channel;
+
+// ---------------------------------------------------------------------------
+// s wave, scalar exchange
+template<>
+struct spin_channel<0>
+{
+  static const int nQ = 1;
+  static const int power = -1;
+
+  static inline std::complex<double> projection(const projection_inputs & in)
+  {
+    return in.Q[0];
+  };
+
+  static inline void feynman(int npt, const double * z, const double * delta, double s, double mDec2, double * A, double * B)
+  {
+    for (int i = 0; i < npt; i++)
+    {
+      A[i] = 0.; B[i] = 1.;
+    }
+  };
+};
+
+// ---------------------------------------------------------------------------
+// s wave, vector exchange
+template<>
+struct spin_channel<1>
+{
+  static const int nQ = 2;
+  static const int power = 0;
+
+  static inline std::complex<double> projection(const projection_inputs & in)
+  {
+    return in.Q[1] + (2.*in.s - in.mDec2 - 3.*mPi2) * in.Q[0];
+  };
+
+  static inline void feynman(int npt, const double * z, const double * delta, double s, double mDec2, double * A, double * B)
+  {
+    for (int i = 0; i < npt; i++)
+    {
+      A[i] = 1.; B[i] = delta[i] + 2.*s - mDec2 - 3.*mPi2;
+    }
+  };
+};
+
+// ---------------------------------------------------------------------------
+// p - wave, scalar exchange
+template<>
+struct spin_channel<10>
+{
+  static const int nQ = 2;
+  static const int power = -1;
+
+  static inline std::complex<double> projection(const projection_inputs & in)
+  {
+    return (2. * in.Q[1] + (in.s - in.mDec2 - 3.*mPi2) * in.Q[0]) / in.psqr;
+  };
+
+  static inline void feynman(int npt, const double * z, const double * delta, double s, double mDec2, double * A, double * B)
+  {
+    for (int i = 0; i < npt; i++)
+    {
+      A[i] = 0.; B[i] = z[i];
+    }
+  };
+};
+
+// ---------------------------------------------------------------------------
+// p - wave, vector exchange
+template<>
+struct spin_channel<11>
+{
+  static const int nQ = 3;
+  static const int power = 0;
+
+  static inline std::complex<double> projection(const projection_inputs & in)
+  {
+    std::complex<double> s = in.s;
+    double mDec2 = in.mDec2;
+
+    std::complex<double> result;
+    result  = 2. * in.Q[2];
+    result += (5.*s - 3. * mDec2 - 9. * mPi2) * in.Q[1];
+    result += (2.*s*s - 3.*mDec2*s - 9.*mPi2*s + mDec2*mDec2 + 6.*mDec2*mPi2 + 9.*mPi2*mPi2) * in.Q[0];
+    return result / in.psqr;
+  };
+
+  static inline void feynman(int npt, const double * z, const double * delta, double s, double mDec2, double * A, double * B)
+  {
+    for (int i = 0; i < npt; i++)
+    {
+      A[i] = (3.*z[i] - 1.) / 2.;
+      B[i] = z[i] * (delta[i] + 2.*s - mDec2 - 3.*mPi2);
+    }
+  };
+};
+
+// ---------------------------------------------------------------------------
+// d-wave scalar exchange
+template<>
+struct spin_channel<20>
+{
+  static const int nQ = 3;
+  static const int power = -1;
+
+  static inline std::complex<double> projection(const projection_inputs & in)
+  {
+    // 3 z^2 - 1
+    return 3. * z2_moment(in) / (in.psqr * in.psqr) - in.Q[0] * in.qsqr / in.psqr;
+  };
+
+  static inline void feynman(int npt, const double * z, const double * delta, double s, double mDec2, double * A, double * B)
+  {
+    for (int i = 0; i < npt; i++)
+    {
+      A[i] = 0.; B[i] = z[i]*z[i];
+    }
+  };
+};
+
+// ---------------------------------------------------------------------------
+// a1 lam = 0 lamp = 0, s-wave, scalar exchange
+template<>
+struct spin_channel<10000>
+{
+  static const int nQ = 2;
+  static const int power = 1;
+
+  static inline std::complex<double> projection(const projection_inputs & in)
+  {
+    std::complex<double> s = in.s;
+    double mDec2 = in.mDec2;
+
+    std::complex<double> result;
+    result  = (s + mDec2 - mPi2) * in.Q[1];
+    result += (s - mDec2 - mPi2) * (mDec2 - mPi2) * in.Q[0];
+    return result;
+  };
+
+  static inline void feynman(int npt, const double * z, const double * delta, double s, double mDec2, double * A, double * B)
+  {
+    for (int i = 0; i < npt; i++)
+    {
+      A[i]  = (s + mDec2 - mPi2);
+      B[i]  = (s + mDec2 - mPi2) * delta[i];
+      B[i] += (s - mDec2 - mPi2) * (mDec2 - mPi2);
+    }
+  };
+};
+
+// ---------------------------------------------------------------------------
+// Omega case
+template<>
+struct spin_channel<-11111>
+{
+  static const int nQ = 3;
+  static const int power = 0;
+
+  static inline std::complex<double> projection(const projection_inputs & in)
+  {
+    // q^2 * (1 - z^2)
+    return in.Q[0] * in.qsqr - z2_moment(in) / in.psqr;
+  };
+
+  static inline void feynman(int npt, const double * z, const double * delta, double s, double mDec2, double * A, double * B)
+  {
+    for (int i = 0; i < npt; i++)
+    {
+      A[i] = - 2.; B[i] = 0.;
+    }
+  };
+};
+
+#endif
@@ -0,0 +1,33 @@
+// Exception thrown in place of quitting when an amplitude is set up with
+// parameters it cannot evaluate (unknown channel, too few subtractions, ...)
+// so programs evaluating many channels can recover and carry on.
+//
+// The quantum numbers and accuracy_policy are validated when amplitudes are
+// constructed (and by set_policy), so evaluating them at real s and t doesnt throw.
+// Evaluations taking arguments which may not make sense throw on bad ones:
+//  - dispersive_triangle::eval on the second sheet from above the real axis
+//  - dispersive_triangle::eval_uniform with N < 2, s_high <= s_low, or oversample < 1
+//  - amplitude_grid::eval before build(), and build() with an empty range
+//  - parallel_scan::eval with unavailable channels or a sink of a different scan
+// The result sinks also throw when their files cant be opened or written.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _TRI_ERROR_
+#define _TRI_ERROR_
+
+#include <stdexcept>
+#include <string>
+
+class triangle_error : public std::runtime_error
+{
+public:
+  triangle_error(std::string where, std::string what)
+  : std::runtime_error(where + ": " + what)
+  {};
+};
+
+#endif
@@ -0,0 +1,24 @@
+// Value of a triangle amplitude along with its derivatives with respect to
+// the CoM energy^2, s, and the exchange mass^2, t, at the same point.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#ifndef _TRI_GRAD_
+#define _TRI_GRAD_
+
+#include "constants.hpp"
+
+struct triangle_gradient
+{
+  std::complex<double> value = 0.;
+  std::complex<double> ds = 0., dt = 0.;
+
+  // Error estimates of the derivatives
+  // that of the value is the error() of the amplitude as usual
+  double ds_err = 0., dt_err = 0.;
+};
+
+#endif
@@ -0,0 +1,505 @@
+// Interpolation of the triangle amplitude as a function of both s and the
+// exchange mass t, precomputed once so fits can replace live integration with
+// a fast lookup.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#include "amplitude_grid.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+amplitude_grid::~amplitude_grid()
+{
+  unmap();
+};
+
+// ---------------------------------------------------------------------------
+// Map between the variable u in [0,1] and the variable of the axis
+double amplitude_grid::grid_axis::x(int k, double u) const
+{
+  return breaks[k] + (breaks[k+1] - breaks[k]) * (1. - cos(M_PI * u)) / 2.;
+};
+
+// ---------------------------------------------------------------------------
+// Find the cell containing x, values outside the axis are moved to the edge
+void amplitude_grid::grid_axis::locate(double x, int & cell, double & w, double & h) const
+{
+  x = std::max(breaks.front(), std::min(breaks.back(), x));
+
+  // Segment
+  int k = std::upper_bound(breaks.begin(), breaks.end(), x) - breaks.begin() - 1;
+  k = std::max(0, std::min(int(breaks.size()) - 2, k));
+
+  double arg = 1. - 2. * (x - breaks[k]) / (breaks[k+1] - breaks[k]);
+  double ux = acos(std::max(-1., std::min(1., arg))) / M_PI;
+
+  // Cell within the segment
+  cell = std::upper_bound(u.begin() + start[k], u.begin() + start[k+1], ux) - u.begin() - 1;
+  cell = std::max(start[k], std::min(start[k+1] - 2, cell));
+
+  h = u[cell+1] - u[cell];
+  w = (ux - u[cell]) / h;
+};
+
+// ---------------------------------------------------------------------------
+std::complex<double> amplitude_grid::hermite(double w, double h, std::complex<double> f0, std::complex<double> d0,
+                                             std::complex<double> f1, std::complex<double> d1)
+{
+  double w2 = w * w, w3 = w2 * w;
+  return (2.*w3 - 3.*w2 + 1.) * f0 + (w3 - 2.*w2 + w) * h * d0
+       + (-2.*w3 + 3.*w2) * f1 + (w3 - w2) * h * d1;
+};
+
+// ---------------------------------------------------------------------------
+// Three-point finite differences on the (non-uniform) nodes of each segment
+void amplitude_grid::derivative(const grid_axis & axis, const std::complex<double> * data, int stride, std::complex<double> * result)
+{
+  const std::vector<double> & u = axis.u;
+  for (int k = 0; k < axis.breaks.size() - 1; k++)
+  {
+    int a = axis.start[k], b = axis.start[k+1] - 1;
+
+    // Only two nodes, linear
+    if (b - a == 1)
+    {
+      std::complex<double> d = (data[b*stride] - data[a*stride]) / (u[b] - u[a]);
+      result[a*stride] = d; result[b*stride] = d;
+      continue;
+    }
+
+    for (int i = a; i <= b; i++)
+    {
+      // Use the two neighbors, or the next two at the ends
+      int c = std::max(a + 1, std::min(b - 1, i));
+      double h0 = u[c] - u[c-1], h1 = u[c+1] - u[c];
+      std::complex<double> f0 = data[(c-1)*stride], f1 = data[c*stride], f2 = data[(c+1)*stride];
+
+      if (i == a)
+      {
+        result[i*stride] = - (2.*h0 + h1) / (h0 * (h0 + h1)) * f0 + (h0 + h1) / (h0 * h1) * f1 - h0 / (h1 * (h0 + h1)) * f2;
+      }
+      else if (i == b)
+      {
+        result[i*stride] = h1 / (h0 * (h0 + h1)) * f0 - (h0 + h1) / (h0 * h1) * f1 + (2.*h1 + h0) / (h1 * (h0 + h1)) * f2;
+      }
+      else
+      {
+        result[i*stride] = h0 / (h0 + h1) * (f2 - f1) / h1 + h1 / (h0 + h1) * (f1 - f0) / h0;
+      }
+    }
+  }
+};
+
+// ---------------------------------------------------------------------------
+// Bicubic Hermite interpolation
+std::complex<double> amplitude_grid::eval(double s, double t)
+{
+  if (data == NULL)
+  {
+    throw triangle_error("amplitude_grid", "eval() called before build()");
+  }
+
+  int i, j;
+  double ws, hs, wt, ht;
+  s_axis.locate(s, i, ws, hs);
+  t_axis.locate(t, j, wt, ht);
+
+  // Hermite basis functions for values and derivatives at either end of the cell
+  double ws2 = ws * ws, ws3 = ws2 * ws, wt2 = wt * wt, wt3 = wt2 * wt;
+  double vs[2] = {2.*ws3 - 3.*ws2 + 1., -2.*ws3 + 3.*ws2};
+  double ds[2] = {(ws3 - 2.*ws2 + ws) * hs, (ws3 - ws2) * hs};
+  double vt[2] = {2.*wt3 - 3.*wt2 + 1., -2.*wt3 + 3.*wt2};
+  double dt[2] = {(wt3 - 2.*wt2 + wt) * ht, (wt3 - wt2) * ht};
+
+  int N = s_axis.u.size() * t_axis.u.size(), Nt = t_axis.u.size();
+  const std::complex<double> * f = data, * fs = data + N, * ft = data + 2*N, * fst = data + 3*N;
+
+  std::complex<double> result = 0.;
+  for (int a = 0; a < 2; a++)
+  {
+    for (int b = 0; b < 2; b++)
+    {
+      int k = (i + a) * Nt + (j + b);
+      result += vs[a] * vt[b] * f[k] + ds[a] * vt[b] * fs[k]
+              + vs[a] * dt[b] * ft[k] + ds[a] * dt[b] * fst[k];
+    }
+  }
+
+  return result;
+};
+
+// ---------------------------------------------------------------------------
+// Adaptively refine the mesh in s and t
+void amplitude_grid::build(std::function<std::vector<std::complex<double>>(const std::vector<scan_point> &)> evaluator,
+                           quantum_numbers qns, double s_low, double s_high, double t_low, double t_high, double xtol)
+{
+  id = qns.id(); n = qns.n; l = qns.l;
+  mDec = qns.mDec; tol = xtol;
+
+  if (s_high <= s_low || t_high <= t_low)
+  {
+    throw triangle_error("amplitude_grid", "empty range in s or t");
+  }
+
+  // Segments are split at the threshold and pseudo-thresholds
+  double p_thresh = (mDec - mPi) * (mDec - mPi);
+  double m_thresh = (mDec + mPi) * (mDec + mPi);
+  auto breakpoints = [] (double low, double high, std::vector<double> cusps)
+  {
+    std::vector<double> result = {low, high};
+    for (int i = 0; i < cusps.size(); i++)
+    {
+      if (cusps[i] > low && cusps[i] < high) result.push_back(cusps[i]);
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+  };
+  s_axis.breaks = breakpoints(s_low, s_high, {sthPi, p_thresh, m_thresh});
+  t_axis.breaks = breakpoints(t_low, t_high, {p_thresh});
+
+  // Nodes of each segment while refining
+  // and the left end of intervals which have already converged
+  std::vector<std::set<double>> s_nodes(s_axis.breaks.size() - 1), t_nodes(t_axis.breaks.size() - 1);
+  std::vector<std::set<double>> s_done(s_nodes.size()), t_done(t_nodes.size());
+  for (int k = 0; k < s_nodes.size(); k++) for (int i = 0; i <= n_init; i++) s_nodes[k].insert(double(i) / n_init);
+  for (int k = 0; k < t_nodes.size(); k++) for (int i = 0; i <= n_init; i++) t_nodes[k].insert(double(i) / n_init);
+
+  // Flatten the nodes of each segment into the axis
+  auto flatten = [] (grid_axis & axis, std::vector<std::set<double>> & nodes)
+  {
+    axis.u.clear(); axis.start.clear();
+    for (int k = 0; k < nodes.size(); k++)
+    {
+      axis.start.push_back(axis.u.size());
+      axis.u.insert(axis.u.end(), nodes[k].begin(), nodes[k].end());
+    }
+    axis.start.push_back(axis.u.size());
+  };
+
+  // Where the amplitude is actually evaluated
+  // the ends of segments are moved inside since the amplitude may diverge there
+  auto position = [&] (const grid_axis & axis, int k, double u)
+  {
+    return axis.x(k, std::max(u_min, std::min(1. - u_min, u)));
+  };
+
+  // All values calculated so far
+  std::map<std::pair<double, double>, std::complex<double>> values;
+
+  // An interval of one axis which hasnt converged yet
+  struct interval
+  {
+    int seg, node;
+    double u0, u1;
+  };
+
+  bool capped = false;
+  for (int iter = 0; ; iter++)
+  {
+    flatten(s_axis, s_nodes);
+    flatten(t_axis, t_nodes);
+    int Ns = s_axis.u.size(), Nt = t_axis.u.size();
+
+    std::vector<double> xs(Ns), xt(Nt);
+    for (int k = 0; k < s_nodes.size(); k++)
+      for (int i = s_axis.start[k]; i < s_axis.start[k+1]; i++) xs[i] = position(s_axis, k, s_axis.u[i]);
+    for (int k = 0; k < t_nodes.size(); k++)
+      for (int j = t_axis.start[k]; j < t_axis.start[k+1]; j++) xt[j] = position(t_axis, k, t_axis.u[j]);
+
+    // Intervals to check on each axis
+    auto pending = [&] (const grid_axis & axis, std::vector<std::set<double>> & done)
+    {
+      std::vector<interval> result;
+      if (axis.u.size() >= max_nodes)
+      {
+        capped = true;
+        return result;
+      }
+
+      for (int k = 0; k < done.size(); k++)
+      {
+        for (int i = axis.start[k]; i < axis.start[k+1] - 1; i++)
+        {
+          double u0 = axis.u[i], u1 = axis.u[i+1];
+          if (done[k].count(u0) > 0) continue;
+          if (u1 - u0 < min_width) { done[k].insert(u0); continue; }
+          result.push_back({k, i, u0, u1});
+        }
+      }
+      return result;
+    };
+    std::vector<interval> s_check = pending(s_axis, s_done);
+    std::vector<interval> t_check = pending(t_axis, t_done);
+    if (iter >= max_iter) { s_check.clear(); t_check.clear(); }
+
+    // Everything which hasnt been calculated yet
+    std::set<std::pair<double, double>> needed;
+    for (int i = 0; i < Ns; i++) for (int j = 0; j < Nt; j++) needed.insert(std::make_pair(xs[i], xt[j]));
+    for (int m = 0; m < s_check.size(); m++)
+    {
+      double x = position(s_axis, s_check[m].seg, (s_check[m].u0 + s_check[m].u1) / 2.);
+      for (int j = 0; j < Nt; j++) needed.insert(std::make_pair(x, xt[j]));
+    }
+    for (int m = 0; m < t_check.size(); m++)
+    {
+      double x = position(t_axis, t_check[m].seg, (t_check[m].u0 + t_check[m].u1) / 2.);
+      for (int i = 0; i < Ns; i++) needed.insert(std::make_pair(xs[i], x));
+    }
+
+    std::vector<scan_point> points;
+    for (auto it = needed.begin(); it != needed.end(); ++it)
+    {
+      if (values.find(*it) == values.end()) points.push_back({it->first, it->second, id});
+    }
+
+    std::vector<std::complex<double>> results = evaluator(points);
+    for (int i = 0; i < points.size(); i++) values[std::make_pair(points[i].s, points[i].t)] = results[i];
+
+    if (s_check.empty() && t_check.empty())
+    {
+      if (iter >= max_iter || capped)
+      {
+        std::cout << "\nWarning! amplitude_grid: refinement stopped at " << Ns << " x " << Nt;
+        std::cout << " nodes before reaching tolerance " << tol << ".\n";
+      }
+      break;
+    }
+
+    // Current values on the grid and derivatives along each axis
+    std::vector<std::complex<double>> F(Ns * Nt), Fs(Ns * Nt), Ft(Ns * Nt);
+    std::vector<double> mags(Ns * Nt);
+    for (int i = 0; i < Ns; i++) for (int j = 0; j < Nt; j++)
+    {
+      F[i*Nt + j] = values[std::make_pair(xs[i], xt[j])];
+      mags[i*Nt + j] = std::abs(F[i*Nt + j]);
+    }
+    for (int j = 0; j < Nt; j++) derivative(s_axis, &F[j], Nt, &Fs[j]);
+    for (int i = 0; i < Ns; i++) derivative(t_axis, &F[i*Nt], 1, &Ft[i*Nt]);
+
+    // Typical size of the amplitude so zeros dont require infinite refinement
+    std::nth_element(mags.begin(), mags.begin() + mags.size() / 2, mags.end());
+    double scale = mags[mags.size() / 2];
+
+    // Bisect intervals where the midpoints arent reproduced
+    bool s_added = false, t_added = false;
+    for (int m = 0; m < s_check.size(); m++)
+    {
+      interval & c = s_check[m];
+      double um = (c.u0 + c.u1) / 2., x = position(s_axis, c.seg, um);
+
+      bool converged = true;
+      for (int j = 0; j < Nt && converged; j++)
+      {
+        int k0 = c.node * Nt + j, k1 = (c.node + 1) * Nt + j;
+        std::complex<double> exact = values[std::make_pair(x, xt[j])];
+        std::complex<double> interp = hermite(0.5, c.u1 - c.u0, F[k0], Fs[k0], F[k1], Fs[k1]);
+        converged = std::abs(exact - interp) <= tol * (std::abs(exact) + scale);
+      }
+
+      if (converged) s_done[c.seg].insert(c.u0);
+      else           { s_nodes[c.seg].insert(um); s_added = true; }
+    }
+
+    for (int m = 0; m < t_check.size(); m++)
+    {
+      interval & c = t_check[m];
+      double um = (c.u0 + c.u1) / 2., x = position(t_axis, c.seg, um);
+
+      bool converged = true;
+      for (int i = 0; i < Ns && converged; i++)
+      {
+        int k0 = i * Nt + c.node, k1 = i * Nt + c.node + 1;
+        std::complex<double> exact = values[std::make_pair(xs[i], x)];
+        std::complex<double> interp = hermite(0.5, c.u1 - c.u0, F[k0], Ft[k0], F[k1], Ft[k1]);
+        converged = std::abs(exact - interp) <= tol * (std::abs(exact) + scale);
+      }
+
+      if (converged) t_done[c.seg].insert(c.u0);
+      else           { t_nodes[c.seg].insert(um); t_added = true; }
+    }
+
+    // Intervals of one axis were only checked along the nodes of the other so far,
+    // so they have to be checked again along any new ones
+    // (only the midpoints on the new nodes are actually evaluated again)
+    if (s_added) for (int k = 0; k < t_done.size(); k++) t_done[k].clear();
+    if (t_added) for (int k = 0; k < s_done.size(); k++) s_done[k].clear();
+  }
+
+  // Final values and derivatives at every node
+  unmap();
+  int Ns = s_axis.u.size(), Nt = t_axis.u.size(), N = Ns * Nt;
+  storage.assign(4 * N, 0.);
+  std::complex<double> * f = &storage[0], * fs = f + N, * ft = f + 2*N, * fst = f + 3*N;
+  for (int k = 0; k < s_nodes.size(); k++) for (int i = s_axis.start[k]; i < s_axis.start[k+1]; i++)
+  {
+    for (int q = 0; q < t_nodes.size(); q++) for (int j = t_axis.start[q]; j < t_axis.start[q+1]; j++)
+    {
+      f[i*Nt + j] = values[std::make_pair(position(s_axis, k, s_axis.u[i]), position(t_axis, q, t_axis.u[j]))];
+    }
+  }
+  for (int j = 0; j < Nt; j++) derivative(s_axis, &f[j], Nt, &fs[j]);
+  for (int i = 0; i < Ns; i++) derivative(t_axis, &f[i*Nt], 1, &ft[i*Nt]);
+  for (int j = 0; j < Nt; j++) derivative(s_axis, &ft[j], Nt, &fst[j]);
+
+  data = &storage[0];
+};
+
+// ---------------------------------------------------------------------------
+// Write the header, axes, and values
+bool amplitude_grid::save(std::string file)
+{
+  if (data == NULL)
+  {
+    std::cout << "\nWarning! amplitude_grid: nothing to save to " << file << ".\n";
+    return false;
+  }
+
+  grid_header head;
+  std::memset(&head, 0, sizeof(head));
+  std::strncpy(head.magic, "KTGRID", sizeof(head.magic));
+  head.version = version; head.header_size = sizeof(grid_header);
+  head.id = id; head.n = n; head.l = l;
+  head.mDec = mDec; head.tol = tol;
+  head.s_breaks = s_axis.breaks.size(); head.t_breaks = t_axis.breaks.size();
+  head.s_nodes = s_axis.u.size();       head.t_nodes = t_axis.u.size();
+
+  // Segment starts are saved as 8 byte integers so everything stays aligned
+  std::vector<int64_t> s_start(s_axis.start.begin(), s_axis.start.end());
+  std::vector<int64_t> t_start(t_axis.start.begin(), t_axis.start.end());
+
+  // Write to a temporary file and move it into place
+  // so other processes never see a partial grid
+  std::string temp = file + ".tmp" + std::to_string(getpid());
+  FILE * out = fopen(temp.c_str(), "wb");
+  if (out == NULL)
+  {
+    std::cout << "\nWarning! amplitude_grid: cannot open " << temp << ".\n";
+    return false;
+  }
+
+  size_t N = head.s_nodes * head.t_nodes;
+  bool ok = true;
+  ok = ok && fwrite(&head, sizeof(head), 1, out) == 1;
+  ok = ok && fwrite(&s_axis.breaks[0], sizeof(double), head.s_breaks, out) == head.s_breaks;
+  ok = ok && fwrite(&t_axis.breaks[0], sizeof(double), head.t_breaks, out) == head.t_breaks;
+  ok = ok && fwrite(&s_start[0], sizeof(int64_t), s_start.size(), out) == s_start.size();
+  ok = ok && fwrite(&t_start[0], sizeof(int64_t), t_start.size(), out) == t_start.size();
+  ok = ok && fwrite(&s_axis.u[0], sizeof(double), head.s_nodes, out) == head.s_nodes;
+  ok = ok && fwrite(&t_axis.u[0], sizeof(double), head.t_nodes, out) == head.t_nodes;
+  ok = ok && fwrite(data, sizeof(std::complex<double>), 4 * N, out) == 4 * N;
+  ok = (fclose(out) == 0) && ok;
+
+  if (!ok || rename(temp.c_str(), file.c_str()) != 0)
+  {
+    std::cout << "\nWarning! amplitude_grid: failed to write " << file << ".\n";
+    remove(temp.c_str());
+    return false;
+  }
+
+  return true;
+};
+
+// ---------------------------------------------------------------------------
+// Segment starts read from a file must begin at 0, end at the number of nodes
+// and give every segment at least the two nodes locate() needs
+static bool valid_starts(const int64_t * start, int64_t breaks, int64_t nodes)
+{
+  if (start[0] != 0 || start[breaks - 1] != nodes) return false;
+  for (int64_t k = 0; k < breaks - 1; k++)
+  {
+    if (start[k+1] - start[k] < 2) return false;
+  }
+  return true;
+};
+
+// Map the file and point the values directly into it
+bool amplitude_grid::load(std::string file)
+{
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  fstat(fd, &st);
+  size_t size = st.st_size;
+
+  const char * new_map = NULL;
+  if (size >= sizeof(grid_header)) new_map = (const char *) mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (new_map == NULL || new_map == MAP_FAILED)
+  {
+    std::cout << "\nWarning! amplitude_grid: cannot map " << file << ".\n";
+    return false;
+  }
+
+  // Check the header and that the file has the size it says
+  // Counts larger than the file are rejected first so the sizes cant overflow
+  const grid_header * head = (const grid_header *) new_map;
+  int64_t most = size / sizeof(double);
+  bool counts = head->s_breaks >= 2 && head->t_breaks >= 2 && head->s_nodes >= 2 && head->t_nodes >= 2
+             && head->s_breaks <= most && head->t_breaks <= most && head->s_nodes <= most && head->t_nodes <= most
+             && head->s_nodes <= most / head->t_nodes;
+
+  size_t N = counts ? head->s_nodes * head->t_nodes : 0;
+  size_t expected = sizeof(grid_header)
+                  + sizeof(double)  * (head->s_breaks + head->t_breaks + head->s_nodes + head->t_nodes)
+                  + sizeof(int64_t) * (head->s_breaks + head->t_breaks)
+                  + sizeof(std::complex<double>) * 4 * N;
+
+  // The segment starts are used as indices into the nodes so they are checked too
+  const double * s_breaks = (const double *) (new_map + sizeof(grid_header));
+  const double * t_breaks = s_breaks + head->s_breaks;
+  const int64_t * s_start = (const int64_t *) (t_breaks + head->t_breaks);
+  const int64_t * t_start = s_start + head->s_breaks;
+
+  if (std::strncmp(head->magic, "KTGRID", 6) != 0 || head->version != version
+      || head->header_size != sizeof(grid_header) || !counts || expected != size
+      || !valid_starts(s_start, head->s_breaks, head->s_nodes)
+      || !valid_starts(t_start, head->t_breaks, head->t_nodes))
+  {
+    std::cout << "\nWarning! amplitude_grid: " << file << " is not a compatible grid.\n";
+    munmap((void *) new_map, size);
+    return false;
+  }
+
+  unmap();
+  storage.clear();
+  map = new_map; map_size = size;
+
+  id = head->id; n = head->n; l = head->l;
+  mDec = head->mDec; tol = head->tol;
+
+  // The axes are small so they are copied
+  const double * s_u = (const double *) (t_start + head->t_breaks);
+  const double * t_u = s_u + head->s_nodes;
+
+  s_axis.breaks.assign(s_breaks, s_breaks + head->s_breaks);
+  t_axis.breaks.assign(t_breaks, t_breaks + head->t_breaks);
+  s_axis.start.assign(s_start, s_start + head->s_breaks);
+  t_axis.start.assign(t_start, t_start + head->t_breaks);
+  s_axis.u.assign(s_u, s_u + head->s_nodes);
+  t_axis.u.assign(t_u, t_u + head->t_nodes);
+
+  // While the values are used in place
+  data = (const std::complex<double> *) (t_u + head->t_nodes);
+
+  return true;
+};
+
+// ---------------------------------------------------------------------------
+void amplitude_grid::unmap()
+{
+  if (map != NULL) munmap((void *) map, map_size);
+  map = NULL; map_size = 0;
+  data = NULL;
+};
@@ -0,0 +1,143 @@
+// Discrete Hilbert transform of a function sampled on a uniform grid.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#include "dispersive/discrete_hilbert.hpp"
+
+// ---------------------------------------------------------------------------
+// Iterative Cooley-Tukey with bit reversal
+void fft(std::vector<std::complex<double>> & x, bool inverse)
+{
+  int n = x.size();
+
+  for (int i = 1, j = 0; i < n; i++)
+  {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+    if (i < j) std::swap(x[i], x[j]);
+  }
+
+  for (int len = 2; len <= n; len <<= 1)
+  {
+    double angle = 2. * M_PI / double(len) * (inverse ? 1. : -1.);
+    std::complex<double> wlen(cos(angle), sin(angle));
+    for (int i = 0; i < n; i += len)
+    {
+      std::complex<double> w = 1.;
+      for (int k = 0; k < len / 2; k++)
+      {
+        std::complex<double> u = x[i + k], v = x[i + k + len/2] * w;
+        x[i + k] = u + v;
+        x[i + k + len/2] = u - v;
+        w *= wlen;
+      }
+    }
+  }
+
+  if (inverse)
+  {
+    for (int i = 0; i < n; i++) x[i] /= double(n);
+  }
+};
+
+// ---------------------------------------------------------------------------
+// x log|x| with the limit 0 at x = 0
+static double xlog(double x)
+{
+  return (x == 0.) ? 0. : x * log(std::abs(x));
+};
+
+// w(d) = (d+1) log|d+1| + (d-1) log|d-1| - 2 d log|d|
+// which cancels down to ~ 1 / d, so far away it is evaluated as
+// d log(1 - 1/d^2) + 2 atanh(1/d) instead
+double hat_weight(double d)
+{
+  if (std::abs(d) < 2.) return xlog(d + 1.) + xlog(d - 1.) - 2. * xlog(d);
+
+  double x = 1. / d;
+  return d * log1p(- x*x) + 2. * atanh(x);
+};
+
+// ---------------------------------------------------------------------------
+// Half hat functions on [p, q] which rise from 0 at p to 1 at q (or fall if not rising)
+// The log|q - s| terms are left out and returned separately in log_q
+// since they cancel between the two halves of a sample at s = q
+static double half_hat(double p, double q, double s, bool rising, double & log_q)
+{
+  if (rising)
+  {
+    log_q += (s - p) / (q - p);
+    return 1. - xlog(s - p) / (q - p);
+  }
+
+  log_q -= (p - s) / (p - q);
+  return - 1. + xlog(p - s) / (p - q);
+};
+
+// ---------------------------------------------------------------------------
+std::vector<std::complex<double>> cauchy_uniform(const std::vector<std::complex<double>> & f, double x0, double dx,
+                                                 int j_low, double low, int step, int N)
+{
+  int M = f.size();
+  std::vector<std::complex<double>> result(N, 0.);
+  if (M < 2) return result;
+
+  auto x = [&](int j)
+  {
+    return x0 + double(j) * dx;
+  };
+
+  // Samples at both ends
+  int j_high = j_low + M - 1;
+  for (int k = 0; k < N; k++)
+  {
+    double s = x(k * step);
+    double log_q, w;
+
+    // first sample, half hats from the zero at low and to the next sample
+    log_q = 0.;
+    w  = half_hat(low, x(j_low), s, true, log_q);
+    w += half_hat(x(j_low + 1), x(j_low), s, false, log_q);
+    if (s != x(j_low)) w += log_q * log(std::abs(x(j_low) - s));
+    result[k] += f[0] * w;
+
+    // last sample, only the half hat from the sample before
+    log_q = 0.;
+    w  = half_hat(x(j_high - 1), x(j_high), s, true, log_q);
+    w += log_q * log(std::abs(x(j_high) - s));
+    result[k] += f[M - 1] * w;
+  }
+
+  // Interior samples, j = j_low + 1 + i for i = 0, ..., Mi - 1
+  // contribute sum_i f_i w(i - o) with o = k step - j_low - 1
+  // and as w is odd, this is minus the convolution of f with w at o
+  int Mi = M - 2;
+  if (Mi < 1) return result;
+
+  int o_min = - j_low - 1, o_max = (N - 1) * step - j_low - 1;
+  int q_low = o_min - (Mi - 1);
+  int Lw = o_max - q_low + 1;
+
+  int size = 1;
+  while (size < Mi + Lw - 1) size <<= 1;
+
+  std::vector<std::complex<double>> a(size, 0.), g(size, 0.);
+  for (int i = 0; i < Mi; i++) a[i] = f[i + 1];
+  for (int q = 0; q < Lw; q++) g[q] = hat_weight(double(q + q_low));
+
+  fft(a); fft(g);
+  for (int i = 0; i < size; i++) a[i] *= g[i];
+  fft(a, true);
+
+  for (int k = 0; k < N; k++)
+  {
+    int o = k * step - j_low - 1;
+    result[k] -= a[o - q_low];
+  }
+
+  return result;
+};
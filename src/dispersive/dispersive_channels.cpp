@@ -0,0 +1,177 @@
+// Dispersive evaluation of several spin channels at the same s, t, and decay mass.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#include "dispersive/dispersive_channels.hpp"
+
+#include <algorithm>
+
+// ---------------------------------------------------------------------------
+dispersive_channels::dispersive_channels(quantum_numbers * xqn, std::vector<int> xids, accuracy_policy xpol)
+: ids(xids), n(xqn->n), plan(xqn->mDec)
+{
+  if (ids.size() > channel_values::max_channels)
+  {
+    throw triangle_error("dispersive_channels", "at most " + std::to_string(channel_values::max_channels)
+                         + " channels can be evaluated together");
+  }
+
+  for (int i = 0; i < ids.size(); i++)
+  {
+    quantum_numbers * x = new quantum_numbers(*xqn);
+    x->set_id(ids[i]);
+    qns.push_back(x);
+  }
+
+  try
+  {
+    samples = new spectral_samples(qns);
+    power = samples->power();
+    set_policy(xpol);
+  }
+  catch (...)
+  {
+    clear();
+    throw;
+  }
+};
+
+// ---------------------------------------------------------------------------
+void dispersive_channels::clear()
+{
+  for (int i = 0; i < qns.size(); i++) delete qns[i];
+  delete samples;
+  qns.clear(); samples = NULL;
+};
+
+// ---------------------------------------------------------------------------
+// exp-sinh only applies to intervals extending to infinity
+void dispersive_channels::set_policy(accuracy_policy x)
+{
+  if (x.interval_rule == kExpSinh)
+  {
+    throw triangle_error("dispersive_channels", "exp-sinh cant be used between branch points");
+  }
+
+  policy = x;
+  samples->clear();
+  sr_t = std::numeric_limits<double>::quiet_NaN();
+  clear_partitions();
+};
+
+// ---------------------------------------------------------------------------
+std::vector<std::complex<double>> dispersive_channels::eval(double s, double t)
+{
+  std::vector<std::vector<std::complex<double>>> grid = eval(std::vector<double>(1, s), t);
+
+  std::vector<std::complex<double>> result(ids.size());
+  for (int i = 0; i < ids.size(); i++) result[i] = grid[i][0];
+
+  return result;
+};
+
+// ---------------------------------------------------------------------------
+// Quadrature nodes are mostly the same for every s so the samples are kept
+// until the whole grid is done
+std::vector<std::vector<std::complex<double>>> dispersive_channels::eval(const std::vector<double> & s, double t)
+{
+  sum_rules(t);
+
+  double max_err = 0.;
+  std::vector<std::vector<std::complex<double>>> result(ids.size(), std::vector<std::complex<double>>(s.size()));
+  for (int k = 0; k < s.size(); k++)
+  {
+    err = 0.;
+    std::vector<std::complex<double>> values = s_dispersion(s[k], t);
+    for (int i = 0; i < ids.size(); i++) result[i][k] = values[i] + sr[i] * pow(s[k], double(n));
+    err += sr_err * pow(std::abs(s[k]), double(n));
+    max_err = std::max(max_err, err);
+  }
+  err = max_err;
+
+  // Only the samples at the nodes of the sum rules are needed again
+  samples->clear();
+
+  return result;
+};
+
+// ---------------------------------------------------------------------------
+// Same as dispersive_triangle::s_dispersion for all channels at once
+std::vector<std::complex<double>> dispersive_channels::s_dispersion(double s, double t)
+{
+  int nch = ids.size(), m = std::max(n, 1);
+
+  // Subtracted spectral functions at the external point
+  const std::complex<double> * at_s = samples->at(s, t);
+  std::vector<std::complex<double>> spec_s(at_s, at_s + nch);
+
+  auto dsprime = [&](double sp)
+  {
+    double r = s / sp;
+    const std::complex<double> * spec = samples->at(sp, t);
+
+    channel_values temp;
+    temp.resize(nch);
+    for (int i = 0; i < nch; i++)
+    {
+      temp[i]  = spec[i] * r;
+      temp[i] -= spec_s[i] * pow(r, double(m - n));
+      temp[i] *= pow(r, double(n));
+      temp[i] /= (sp - s - ieps);
+    }
+    return temp;
+  };
+
+  double p = std::min(double(n + 2 - power), double(m + 1));
+
+  double error = 0.;
+  channel_values integral = plan.integrate(dsprime, p, policy, error, partitions(s_partitions));
+  err += error / M_PI;
+
+  // int (s/sp)^m / (sp - s) from threshold to infinity, the same for every channel
+  std::complex<double> log_term = - (log(sthPi - s * xr) - log(sthPi));
+  for (int k = 1; k < m; k++)
+  {
+    log_term -= pow(s, double(k)) / double(k) * pow(sthPi, -double(k));
+  }
+
+  // An integral without components is zero, e.g. if every node was dropped as not finite
+  std::vector<std::complex<double>> result(nch);
+  for (int i = 0; i < nch; i++)
+  {
+    std::complex<double> value = integral.empty() ? 0. : integral[i];
+    result[i] = (value + spec_s[i] * log_term) / M_PI;
+  }
+
+  return result;
+};
+
+// ---------------------------------------------------------------------------
+// int ds' rho(s') Q(s', t) / s'^(n+1) for all channels at once
+void dispersive_channels::sum_rules(double t)
+{
+  if (t == sr_t) return;
+
+  int nch = ids.size();
+
+  auto dsprime = [&](double sp)
+  {
+    const std::complex<double> * spec = samples->at(sp, t);
+
+    channel_values temp;
+    temp.resize(nch);
+    for (int i = 0; i < nch; i++) temp[i] = spec[i] / (sp * pow(sp, double(n)));
+    return temp;
+  };
+
+  sr_err = 0.;
+  channel_values integral = plan.integrate(dsprime, double(n + 1 - power), policy, sr_err, partitions(sr_partitions));
+  sr_err /= M_PI;
+
+  sr.assign(nch, 0.);
+  for (int i = 0; i < nch && !integral.empty(); i++) sr[i] = integral[i] / M_PI;
+  sr_t = t;
+};
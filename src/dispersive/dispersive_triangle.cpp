@@ -8,76 +8,618 @@
 
 #include "dispersive/dispersive_triangle.hpp"
 
+#include <algorithm>
+
 std::complex<double> dispersive_triangle::eval(double s, double t)
 {
+  KT_RESET(info);
+
+  std::complex<double> result;
+  if (cache_file != NULL && cache_file->find(key(s, t), result, &err)) return result;
+
   // Store s and t so i dont have to keep passing them around
   fix_energies(s, t);
+  update_table();
+
+  err = 0.;
+  result = s_dispersion() + sum_rule() * pow(s, double(qns->n));
+  err += sr_err * pow(std::abs(s), double(qns->n));
+
+  if (cache_file != NULL) cache_file->store(key(s, t), result, err);
+
+  return result;
+};
+
+// ---------------------------------------------------------------------------
+// Evaluate a whole grid of s values at fixed t
+std::vector<std::complex<double>> dispersive_triangle::eval(const std::vector<double> & s, double t)
+{
+  KT_RESET(info);
+
+  // Quadrature nodes are the same for every s so save the spectral function
+  // and the sum rule doesnt depend on s so only calculate it once
+  reuse_samples(t);
+  std::complex<double> sr = cache_sr;
+  sr_err = cache_sr_err;
+
+  double max_err = 0.;
+  std::vector<std::complex<double>> result(s.size());
+  for (int i = 0; i < s.size(); i++)
+  {
+    if (cache_file != NULL && cache_file->find(key(s[i], t), result[i], &err))
+    {
+      max_err = std::max(max_err, err);
+      continue;
+    }
 
-  // Pseudo threshold
-  double p_thresh = (qns->mDec - mPi) * (qns->mDec - mPi);
+    fix_energies(s[i], t);
+    err = 0.;
+    result[i] = s_dispersion() + sr * pow(s[i], double(qns->n));
+    err += sr_err * pow(std::abs(s[i]), double(qns->n));
+    max_err = std::max(max_err, err);
+
+    if (cache_file != NULL) cache_file->store(key(s[i], t), result[i], err);
+  }
+  err = max_err;
+
+  use_cache = false;
+
+  return result;
+};
+
+// ---------------------------------------------------------------------------
+// Evaluate a uniform grid of s values at fixed t through a discrete Hilbert transform
+// With n + 1 subtractions the dispersion integral is
+// s^(n+1) int ds' h(s') / (s' - s - ieps), with h(s') = rho(s') Q(s', t) / s'^(n+1)
+// which is split into the sampled window from threshold up to high and the tail
+// int_high^infinity ds' h(s') / (s' - s) = sum_k s^k int_high^infinity ds' h(s') / s'^(k+1)
+std::vector<std::complex<double>> dispersive_triangle::eval_uniform(double s_low, double s_high, int N, double t, int oversample)
+{
+  if (N < 2 || !(s_high > s_low) || oversample < 1)
+  {
+    throw triangle_error("dispersive_triangle::eval_uniform", "need N > 1 points with s_high > s_low and oversample > 0");
+  }
+
+  // Samples at x_j = s_low + j dx from the first above threshold to the last at high
+  double dx = (s_high - s_low) / double(N - 1) / double(oversample);
+  double s_max = std::max(std::abs(s_low), std::abs(s_high));
+  double high = std::max(2. * s_max, plan.points.back());
+
+  // The samples always reach up to high, so a narrow window needs many more of them
+  // than there are points, past which evaluating point by point is cheaper
+  if ((high - sthPi) / dx > double(uniform_max_ratio) * double(N) * double(oversample))
+  {
+    std::vector<double> s(N);
+    for (int k = 0; k < N; k++) s[k] = s_low + double(k) * (s_high - s_low) / double(N - 1);
+    return eval(s, t);
+  }
 
+  KT_RESET(info);
+
+  reuse_samples(t);
+  int n = qns->n;
+
+  // j_high is even so that the coarse samples below end at the same point
+  int j_low = int(floor((sthPi - s_low) / dx));
+  while (s_low + double(j_low) * dx <= sthPi) j_low++;
+  int j_high = std::max(j_low + 4, int(ceil((high - s_low) / dx)));
+  if (j_high % 2 != 0) j_high++;
+  high = s_low + double(j_high) * dx;
+
+  std::vector<std::complex<double>> h(j_high - j_low + 1);
+  {
+    KT_TIME(info.dispersion_time);
+    KT_COUNT(info.dispersion_calls, h.size());
+
+    // None of these are reused so they are not saved
+    use_cache = false;
+    for (int j = j_low; j <= j_high; j++)
+    {
+      double sp = s_low + double(j) * dx;
+      h[j - j_low] = spectral(sp) / pow(sp, double(n + 1));
+    }
+    use_cache = true;
+  }
+
+  std::vector<std::complex<double>> window = cauchy_uniform(h, s_low, dx, j_low, sthPi, oversample, N);
+
+  // Same from only the samples with even j, which include every s_k
+  std::vector<std::complex<double>> coarse;
+  if (oversample % 2 == 0)
+  {
+    int i0 = (j_low % 2 == 0) ? 0 : 1;
+    std::vector<std::complex<double>> h2;
+    for (int i = i0; i < h.size(); i += 2) h2.push_back(h[i]);
+
+    coarse = cauchy_uniform(h2, s_low, 2. * dx, (j_low + i0) / 2, sthPi, oversample / 2, N);
+  }
+
+  // Moments of the tail, with |s| / high <= 1/2 the expansion converges
+  // to double precision within ~ 50 terms. All of them are integrated with
+  // the mapping of the slowest falloff (k = 0), so they share the same nodes
+  // and the spectral function is only calculated once for all of them
+  double ratio = s_max / high;
+  int K = std::min(60, 1 + int(ceil(log(1.E-16) / log(std::max(ratio, 1.E-3)))));
+
+  std::vector<std::complex<double>> moments(K);
+  std::vector<double> moments_err(K, 0.);
+  {
+    KT_TIME(info.dispersion_time);
+    for (int k = 0; k < K; k++)
+    {
+      auto dsprime = [&](double sp)
+      {
+        KT_COUNT(info.dispersion_calls, 1);
+        return spectral(sp) / pow(sp, double(n + k + 2));
+      };
+      moments[k] = tail_integrate(dsprime, high, double(n + 2 - power()), policy, moments_err[k]);
+    }
+  }
+
+  err = 0.;
+  std::vector<std::complex<double>> result(N);
+  for (int k = 0; k < N; k++)
+  {
+    double s = s_low + double(k * oversample) * dx;
+
+    std::complex<double> tail = 0.;
+    double tail_err = 0.;
+    for (int m = K - 1; m >= 0; m--)
+    {
+      tail = tail * s + moments[m];
+      tail_err = tail_err * std::abs(s) + moments_err[m];
+    }
+
+    // Discontinuity i pi h(s) above threshold, where s is one of the samples
+    int i = k * oversample - j_low;
+    std::complex<double> disc = (i >= 0) ? xi * M_PI * h[i] : 0.;
+
+    double sn1 = pow(s, double(n + 1));
+    result[k] = sn1 * (window[k] + tail + disc) / M_PI + cache_sr * pow(s, double(n));
+
+    double error = cache_sr_err * pow(std::abs(s), double(n)) + std::abs(sn1) * tail_err / M_PI;
+    if (!coarse.empty()) error += std::abs(sn1 * (window[k] - coarse[k])) / (3. * M_PI);
+    err = std::max(err, error);
+  }
+
+  use_cache = false;
+
+  return result;
+};
+
+// ---------------------------------------------------------------------------
+// Evaluate at complex s on either sheet of the unitarity cut
+std::complex<double> dispersive_triangle::eval(std::complex<double> s, double t, bool second_sheet)
+{
+  if (second_sheet && !(std::imag(s) < 0.))
+  {
+    throw triangle_error("dispersive_triangle::eval", "the second sheet is only reached from below the real axis");
+  }
+
+  // On the axis itself the sign of a zero imaginary part would pick the side of the cut,
+  // so real s are the limit from above, same as the real overload
+  if (std::imag(s) == 0.) return eval(std::real(s), t);
+
+  KT_RESET(info);
+
+  reuse_samples(t);
+
+  // Away from the real axis the spectral function is continued directly
+  // and also used to smooth out the integrand close to the real axis
+  std::complex<double> spec_s = spectral(s);
+
+  err = 0.;
   std::complex<double> result;
-  result  = s_dispersion(4.*mPi2, p_thresh - exc);
-  result += s_dispersion(p_thresh + exc, std::numeric_limits<double>::infinity());
+  result = s_dispersion(s, spec_s) + cache_sr * pow(s, double(qns->n));
+  err += cache_sr_err * pow(std::abs(s), double(qns->n));
+
+  // F_II(s) = F_I(s) + 2i rho(s) Q(s,t) below the real axis
+  if (second_sheet) result += 2. * xi * spec_s;
+
+  use_cache = false;
+
+  return result;
+};
+
+// ---------------------------------------------------------------------------
+// Amplitude and its derivatives at real s
+triangle_gradient dispersive_triangle::eval_gradient(double s, double t)
+{
+  KT_RESET(info);
+
+  reuse_samples(t);
+  if (!cache_has_dt)
+  {
+    cache_sr_dt = sum_rule_dt();
+    cache_sr_dt_err = sr_dt_err;
+    cache_has_dt = true;
+  }
+
+  fix_energies(s, t);
+  int n = qns->n;
+
+  triangle_gradient result;
+  err = 0.;
+  result.value = s_dispersion() + cache_sr * pow(s, double(n));
+  err += cache_sr_err * pow(std::abs(s), double(n));
+
+  s_dispersion_gradient(result.ds, result.dt, result.ds_err, result.dt_err);
+  if (n > 0)
+  {
+    result.ds += double(n) * cache_sr * pow(s, double(n - 1));
+    result.ds_err += double(n) * cache_sr_err * pow(std::abs(s), double(n - 1));
+  }
+  result.dt += cache_sr_dt * pow(s, double(n));
+  result.dt_err += cache_sr_dt_err * pow(std::abs(s), double(n));
+
+  use_cache = false;
+
+  return result;
+};
 
-  return result + sum_rule() * s; 
-  // return result + (sum_rule() + 2.33772) * s;
+// ---------------------------------------------------------------------------
+// Start saving samples of the spectral function and calculate the sum rule
+// unless they are already available for this t
+void dispersive_triangle::reuse_samples(double t)
+{
+  use_cache = true;
+
+  fix_energies(0., t);
+  update_table();
+
+  if (t == cache_t && qns->n == cache_n && qns->l == cache_l && qns->id() == cache_id) return;
+
+  cache.clear(); dt_cache.clear();
+  cache_has_dt = false;
+  cache_sr = sum_rule();
+  cache_sr_err = sr_err;
+  cache_t = t; cache_n = qns->n; cache_l = qns->l; cache_id = qns->id();
+};
+
+// ---------------------------------------------------------------------------
+// exp-sinh only applies to intervals extending to infinity
+void dispersive_triangle::check_policy(const accuracy_policy & x)
+{
+  if (x.interval_rule == kExpSinh)
+  {
+    throw triangle_error("dispersive_triangle", "exp-sinh cant be used between branch points");
+  }
 };
 
 // ---------------------------------------------------------------------------
 // Two particle phase-space function
-std::complex<double> dispersive_triangle::rho(double s)
+std::complex<double> dispersive_triangle::rho(std::complex<double> s)
 {
   return sqrt(Kallen(s, mPi2, mPi2)) / s;
 };
 
 // ---------------------------------------------------------------------------
-// calculate the dispersion integral over s with finite bounds of integration
-std::complex<double> dispersive_triangle::s_dispersion(double low, double high)
+// Spectral function, saved if evaluating a grid of s values
+std::complex<double> dispersive_triangle::spectral(double sp)
 {
+  if (interpolate && table.in_range(sp)) return table.eval(sp);
+
+  if (use_cache)
+  {
+    auto found = cache.find(sp);
+    if (found != cache.end()) return found->second;
+
+    std::complex<double> result = rho(sp) * projector.eval(sp, t);
+    cache[sp] = result;
+    return result;
+  }
+
+  return rho(sp) * projector.eval(sp, t);
+};
+
+std::complex<double> dispersive_triangle::spectral(std::complex<double> sp)
+{
+  return rho(sp) * projector.eval(sp, t);
+};
+
+// The value and derivative come from the same kinematics so the value is
+// saved as well if it isnt already
+std::complex<double> dispersive_triangle::spectral_dt(double sp)
+{
+  if (use_cache)
+  {
+    auto found = dt_cache.find(sp);
+    if (found != dt_cache.end()) return found->second;
+  }
+
+  std::complex<double> value, dt, rho_sp = rho(sp);
+  projector.eval(kinematics(sp, t, mDec2), value, dt);
+  dt *= rho_sp;
+
+  if (use_cache)
+  {
+    dt_cache[sp] = dt;
+    if (cache.find(sp) == cache.end()) cache[sp] = rho_sp * value;
+  }
+
+  return dt;
+};
+
+// ---------------------------------------------------------------------------
+// (Re)build the interpolation table if the channel or masses have changed
+void dispersive_triangle::update_table()
+{
+  if (!interpolate || table.matches(qns->id(), qns->l, t, qns->mDec)) return;
+
+  // Nodes are concentrated around threshold and the (pseudo) thresholds
+  // where the spectral function has square-root branch points
+  std::vector<double> points = {4.*mPi2, table_max};
+  points.push_back((qns->mDec - mPi) * (qns->mDec - mPi));
+  points.push_back((qns->mDec + mPi) * (qns->mDec + mPi));
+
+  std::sort(points.begin(), points.end());
+  points.erase(std::unique(points.begin(), points.end()), points.end());
+  points.erase(std::remove_if(points.begin(), points.end(),
+               [&](double x){ return (x < 4.*mPi2) || (x > table_max); }), points.end());
+
+  auto spec = [&](double sp)
+  {
+    return rho(sp) * projector.eval(sp, t);
+  };
+
+  KT_TIME(info.table_time);
+  table.build(spec, points, table_tol);
+  table.set_key(qns->id(), qns->l, t, qns->mDec);
+};
+
+// ---------------------------------------------------------------------------
+// Calculate the dispersion integral over s' from threshold to infinity
+// split at every branch point of the spectral function
+std::complex<double> dispersive_triangle::s_dispersion()
+{
+  KT_TIME(info.dispersion_time);
+
+  // Subtracted spectral function at the external point
+  std::complex<double> spec_s = spectral(s);
+
+  // With n subtractions the integrand is (s/sp)^(n+1) spec(sp) / (sp - s)
+  // from which spec(s) (s/sp)^m / (sp - s) is subtracted and added back analytically
+  // m = n except without subtractions where (s/sp)^0 / (sp - s) wouldnt be integrable
+  int n = qns->n, m = std::max(n, 1);
+
   auto dsprime = [&](double sp)
   {
+    KT_COUNT(info.dispersion_calls, 1);
+
+    double r = s / sp;
+
     std::complex<double> temp;
-    temp = rho(sp) * projector.eval(sp, t) * (s / sp);
-    temp -= rho(s) * projector.eval(s, t);
-    temp *= s / sp;
+    temp = spectral(sp) * r;
+    temp -= spec_s * pow(r, double(m - n));
+    temp *= pow(r, double(n));
     temp /= (sp - s - ieps);
     return temp;
   };
 
+  // At large sp the first term falls as sp^(power - n - 2) and the subtraction as sp^-(m + 1)
+  double p = std::min(double(n + 2 - power()), double(m + 1));
+
+  double error = 0.;
   std::complex<double> result;
-  result = boost::math::quadrature::gauss_kronrod<double, 61>::integrate(dsprime, low, high, 0, 1.E-9, NULL);
+  result = plan.integrate(dsprime, p, policy, error, partitions(s_partitions));
+  err += error / M_PI;
 
+  // int (s/sp)^m / (sp - s) = log(sp - s) - log(sp) - sum_k s^k / (k sp^k)
+  // from threshold to infinity
   std::complex<double> log_term;
-  if (high == std::numeric_limits<double>::infinity())
+  log_term  = - spec_s;
+  log_term *= log(sthPi - s * xr) - log(sthPi);
+
+  for (int k = 1; k < m; k++)
   {
-    // subtracted point
-    log_term  = - rho(s) * projector.eval(s, t);
-    log_term *= log(low - s * xr) - log(low);
+    log_term -= spec_s * pow(s, double(k)) / double(k) * pow(sthPi, -double(k));
   }
-  else
+
+  return (result + log_term) / M_PI;
+};
+
+// ---------------------------------------------------------------------------
+// Same as above at complex s. Off the real axis the integrand has no pole and the
+// subtraction only smooths out the peak at sp = Re s when s is close to the axis
+std::complex<double> dispersive_triangle::s_dispersion(std::complex<double> s, std::complex<double> spec_s)
+{
+  KT_TIME(info.dispersion_time);
+
+  int n = qns->n, m = std::max(n, 1);
+
+  // Integer powers without going through complex logs
+  auto ipow = [](std::complex<double> x, int k)
+  {
+    std::complex<double> result = xr;
+    for (int i = 0; i < k; i++) result *= x;
+    return result;
+  };
+
+  auto dsprime = [&](double sp)
   {
-    // Log term from subtracted singularity
-    log_term = log(high - s * xr) - log(high);
-    log_term -= log(low - s * xr) - log(low);
-    log_term *= rho(s) * projector.eval(s, t);
+    KT_COUNT(info.dispersion_calls, 1);
+
+    std::complex<double> r = s / sp;
+
+    std::complex<double> temp;
+    temp = spectral(sp) * r;
+    temp -= spec_s * ipow(r, m - n);
+    temp *= ipow(r, n);
+    temp /= (sp - s);
+    return temp;
+  };
+
+  double p = std::min(double(n + 2 - power()), double(m + 1));
+
+  double error = 0.;
+  std::complex<double> result;
+  result = plan.integrate(dsprime, p, policy, error);
+  err += error / M_PI;
+
+  // The principal branch of the log gives the first sheet on both sides of the axis
+  std::complex<double> log_term;
+  log_term  = - spec_s;
+  log_term *= log(sthPi - s) - log(sthPi);
+
+  for (int k = 1; k < m; k++)
+  {
+    log_term -= spec_s * ipow(s, k) / double(k) * pow(sthPi, -double(k));
   }
 
   return (result + log_term) / M_PI;
 };
 
+// ---------------------------------------------------------------------------
+// Derivatives of s_dispersion, differentiating the integrand under the integral
+// In the s-derivative the pole at sp = s is subtracted to second order which needs
+// d = d spec(s) / ds. The terms with d cancel exactly between the integral and the
+// analytic terms, but the integrand is only smooth at sp = s if d is accurate,
+// otherwise it keeps a 1 / (sp - s) pole which the quadrature resolves poorly.
+// d is taken from finite differences of the spectral function, one-sided next to
+// a branch point where a central difference would straddle its kink.
+// The errors of both integrals are added to ds_err and dt_err
+void dispersive_triangle::s_dispersion_gradient(std::complex<double> & ds, std::complex<double> & dt,
+                                                double & ds_err, double & dt_err)
+{
+  KT_TIME(info.dispersion_time);
+
+  int n = qns->n, m = std::max(n, 1);
+
+  std::complex<double> spec_s = spectral(s), dt_spec_s = spectral_dt(s);
+
+  // Distance to the closest branch points below and above s
+  double below = std::numeric_limits<double>::infinity(), above = below;
+  for (int i = 0; i < plan.points.size(); i++)
+  {
+    if (plan.points[i] <= s) below = std::min(below, s - plan.points[i]);
+    else                     above = std::min(above, plan.points[i] - s);
+  }
+
+  double h0 = 1.E-5 * std::max(s, sthPi), h = h0;
+  std::complex<double> d;
+  if (below > h && above > h)
+  {
+    d = (spectral(s + h) - spectral(s - h)) / (2. * h);
+  }
+  else if (above >= below)
+  {
+    h = std::min(h, above / 2.);
+    d = (- 3. * spec_s + 4. * spectral(s + h) - spectral(s + 2. * h)) / (2. * h);
+  }
+  else
+  {
+    h = std::min(h, below / 2.);
+    d = (3. * spec_s - 4. * spectral(s - h) + spectral(s - 2. * h)) / (2. * h);
+  }
+
+  // Subtracted to second order the integrand is regular at sp = s and needs no ieps,
+  // the imaginary parts are all in the analytic terms
+  auto ds_subtracted = [&](double sp)
+  {
+    double r = s / sp;
+    double den = sp - s;
+    std::complex<double> spec = spectral(sp);
+
+    std::complex<double> temp;
+    temp  = spec * double(n + 1) * pow(r, double(n));
+    temp -= spec_s * double(m) * pow(r, double(m - 1));
+    temp /= sp;
+    temp -= d * pow(r, double(m));
+    temp /= den;
+    temp += (spec * pow(r, double(n + 1)) - spec_s * pow(r, double(m))) / (den * den);
+    return temp;
+  };
+
+  // Close to s the subtracted terms cancel to roundoff, so across a small window
+  // (not reaching any branch point) the smooth integrand is interpolated linearly
+  double hl = std::min(h0, below / 2.), hr = std::min(h0, above / 2.);
+  std::complex<double> f_lo = (hl > 0.) ? ds_subtracted(s - hl) : ds_subtracted(s + hr);
+  std::complex<double> f_hi = ds_subtracted(s + hr);
+
+  auto ds_sprime = [&](double sp)
+  {
+    KT_COUNT(info.dispersion_calls, 1);
+
+    if (sp >= s - hl && sp <= s + hr) return f_lo + (f_hi - f_lo) * ((sp - s + hl) / (hl + hr));
+    return ds_subtracted(sp);
+  };
+
+  auto dt_sprime = [&](double sp)
+  {
+    KT_COUNT(info.dispersion_calls, 1);
+
+    double r = s / sp;
+
+    std::complex<double> temp;
+    temp  = spectral_dt(sp) * pow(r, double(n + 1));
+    temp -= dt_spec_s * pow(r, double(m));
+    temp /= (sp - s - ieps);
+    return temp;
+  };
+
+  double p = std::min(double(n + 2 - power()), double(m + 1));
+
+  double ds_error = 0., dt_error = 0.;
+  ds = plan.integrate(ds_sprime, p, policy, ds_error);
+  dt = plan.integrate(dt_sprime, p, policy, dt_error);
+  ds_err += ds_error / M_PI;
+  dt_err += dt_error / M_PI;
+
+  // Analytic integral of (s/sp)^m / (sp - s) and its derivative as in s_dispersion
+  std::complex<double> A, dA;
+  A  = - (log(sthPi - s * xr) - log(sthPi));
+  dA = 1. / (sthPi - s);
+  for (int k = 1; k < m; k++)
+  {
+    A  -= pow(s / sthPi, double(k)) / double(k);
+    dA -= pow(s, double(k - 1)) / pow(sthPi, double(k));
+  }
+
+  ds = (ds + spec_s * dA + d * A) / M_PI;
+  dt = (dt + dt_spec_s * A) / M_PI;
+};
+
+// ---------------------------------------------------------------------------
 std::complex<double> dispersive_triangle::sum_rule()
 {
+  KT_TIME(info.sum_rule_time);
+
   auto dsprime = [&](double sp)
   {
+    KT_COUNT(info.sum_rule_calls, 1);
+
     std::complex<double> temp;
-    temp = rho(sp) * projector.eval(sp, t);
-    temp /= sp * sp;
+    temp = spectral(sp);
+    temp /= sp * pow(sp, double(qns->n));
     return temp;
   };
 
+  sr_err = 0.;
   std::complex<double> result;
-  result = boost::math::quadrature::gauss_kronrod<double, 61>::integrate(dsprime, 4.*mPi2, std::numeric_limits<double>::infinity(), 0, 1.E-9, NULL);
-  
+  result = plan.integrate(dsprime, double(qns->n + 1 - power()), policy, sr_err, partitions(sr_partitions));
+  sr_err /= M_PI;
+
+  return result / M_PI;
+};
+
+std::complex<double> dispersive_triangle::sum_rule_dt()
+{
+  KT_TIME(info.sum_rule_time);
+
+  auto dsprime = [&](double sp)
+  {
+    KT_COUNT(info.sum_rule_calls, 1);
+
+    std::complex<double> temp;
+    temp = spectral_dt(sp);
+    temp /= sp * pow(sp, double(qns->n));
+    return temp;
+  };
+
+  sr_dt_err = 0.;
+  std::complex<double> result;
+  result = plan.integrate(dsprime, double(qns->n + 1 - power()), policy, sr_dt_err);
+  sr_dt_err /= M_PI;
+
   return result / M_PI;
 };
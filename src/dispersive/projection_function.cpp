@@ -7,156 +7,85 @@
 
 #include "dispersive/projection_function.hpp"
 
+#include <algorithm>
+#include <vector>
+
 // ---------------------------------------------------------------------------
-// Evaluate the cross-channel exchange projected amplitude
-// Q_{jjp}(s,t)
-std::complex<double> projection_function::eval(double s, double t)
+// Pick out the evaluation for the channel given by qns
+// throws a triangle_error if the channel isnt available
+void projection_function::set_kernel()
 {
-  set_energies(s, t);
-
-  std::complex<double> result = 0.;
-
-  auto error = [&] ()
-  {
-    std::cout << "\nError! projection_function:";
-    std::cout << " j = " << std::to_string(qns->j);
-    std::cout << " and j' = " << std::to_string(qns->jp);
-    std::cout << " (code " << std::to_string(qns->id()) << ")";
-    std::cout << " combination not available. Quitting... \n";
-    exit(1);
-  };
+  check_channel(qns);
 
-  switch (qns->id())
+  kernel_id = qns->id();
+  switch (kernel_id)
   {
-
-    // s wave, scalar exchange
-    case 0:
-    {
-      result = Q(qns->l);
-      break;
-    }
-
-    // s wave, vector exchange
-    case 1:
-    {
-      result  = Q(qns->l+1);
-      result += (2.*s - mDec2 - 3.*mPi2) * Q(qns->l);
-      break;
-    }
-
-    // p - wave, scalar exchangze
-    case 10:
-    {
-      result = 2. * Q(qns->l+1);
-      result += (s - mDec2 - 3.*mPi2) * Q(qns->l);
-      result /= psqr();
-      break;
-    }
-
-    // p - wave, vector exchange
-    case 11:
-    {
-      result = 2. * Q(qns->l+2);
-      result += (5.*s + - 3. * mDec2 - 9. * mPi2) * Q(qns->l+1);
-      result += (2.*s*s - 3.*mDec2*s - 9.*mPi2*s + mDec2*mDec2 + 6.*mDec2*mPi2 + 9.*mPi2*mPi2) * Q(qns->l);
-      result /= psqr();
-      break;
-    }
-
-    // d-wave scalar exchange
-    case 20:
-    {
-      std::complex<double> term1, term2;
-
-      // z^2
-      term1  = 4.* Q(qns->l+2);
-      term1 += (4. * s - 4. * mDec2 - 12. * mPi2) * Q(qns->l+1);
-      term1 += (s*s - 2.*mDec2*s + mDec2*mDec2 - 6.*mPi2*s + 6.*mPi2*mDec2 + 9.*mPi2*mPi2) * Q(qns->l);
-      term1 /= psqr() * psqr();
-
-      // 1
-      term2  = Q(qns->l);
-      term2 *= qsqr() / psqr();
-
-      result = 3. * term1;
-      result -= term2;
-
-      break;
-    }
-
-    // a1 lam = 0 lamp = 0, s-wave, scalar exchange
-    case 10000:
-    {
-      result  = s * Q(qns->l+1);
-      result += (mDec2 - mPi2) * Q(qns->l+1);
-      result += (s - mDec2 - mPi2) * (mDec2 - mPi2) * Q(qns->l);
-
-      break;
-    };
-     
-    // Omega case
-    case -11111:
-    {
-      std::complex<double> term1, term2;
-
-      // q^2 * z^2
-      term1  = 4.* Q(qns->l+2);
-      term1 += (4. * s - 4. * mDec2 - 12. * mPi2) * Q(qns->l+1);
-      term1 += (s*s - 2.*mDec2*s + mDec2*mDec2 - 6.*mPi2*s + 6.*mPi2*mDec2 + 9.*mPi2*mPi2) * Q(qns->l);
-      term1 *= 1. / psqr();
-
-      // q^2 * 1
-      term2  = Q(qns->l);
-      term2 *= qsqr();
-
-      result = term2 - term1;
-      break;
-    };
-
-    default: error();
+    case      0: evaluate = &projection_function::evaluate_channel<0>;      break;
+    case      1: evaluate = &projection_function::evaluate_channel<1>;      break;
+    case     10: evaluate = &projection_function::evaluate_channel<10>;     break;
+    case     11: evaluate = &projection_function::evaluate_channel<11>;     break;
+    case     20: evaluate = &projection_function::evaluate_channel<20>;     break;
+    case  10000: evaluate = &projection_function::evaluate_channel<10000>;  break;
+    case -11111: evaluate = &projection_function::evaluate_channel<-11111>; break;
   }
+};
 
-  result /= pow(t, double(qns->l));
+// ---------------------------------------------------------------------------
+// Evaluate the cross-channel exchange projected amplitude
+// Q_{jjp}(s,t)
+std::complex<double> projection_function::eval(double s, double t)
+{
+  return (this->*kernel())(kinematics(s, t, mDec2), NULL);
+};
 
-  return result;
+std::complex<double> projection_function::eval(std::complex<double> s, double t)
+{
+  return (this->*kernel())(kinematics(s, t, mDec2), NULL);
 };
 
-// ---------------------------------------------------------------------------
-// Angular projection Q kernel functions
-// These are of the form:
-// 1/Kacser(s) * \int_{t_minus}^{t_plus} x^n / (tp - tp - ieps)
-std::complex<double> projection_function::Q_0()
+std::complex<double> projection_function::eval(const kinematics & kin)
 {
-  std::complex<double> result;
-  result  = log(t - ieps - t_minus());
-  result -= log(t - ieps - t_plus());
+  return (this->*kernel())(kin, NULL);
+};
 
-  result /= Kacser();
-  return result;
+void projection_function::eval(const kinematics & kin, std::complex<double> & value, std::complex<double> & dt)
+{
+  value = (this->*kernel())(kin, &dt);
 };
 
-std::complex<double> projection_function::Q(int k)
+// ---------------------------------------------------------------------------
+// Everything the kernel needs is calculated only once
+template<int ID>
+std::complex<double> projection_function::evaluate_channel(const kinematics & kin, std::complex<double> * dt)
 {
-  switch (k)
+  typedef spin_channel<ID> channel;
+
+  projection_inputs in;
+  in.s = kin.s; in.mDec2 = mDec2;
+  in.psqr = kin.psqr;
+  in.qsqr = kin.qsqr;
+
+  int l = qns->l;
+  double tl = pow(kin.t, double(l));
+
+  if (dt == NULL)
   {
-    case 0:
-    {
-      return Q_0();
-    }
-    case 1:
-    {
-      return t * Q_0() - 1.;
-    }
-    case 2:
-    {
-      return t*t * Q_0() - t - 0.5 * (pow(t_plus(), 2.) - pow(t_minus(), 2.)) / Kacser();
-    }
-    default:
-    {
-     std::cout << "\nNot enough Q's!!!\n";
-     exit(1);
-    }
+    kin.Q(l, channel::nQ, in.Q);
+    return channel::projection(in) / tl;
   }
+
+  std::complex<double> dQ[channel::nQ];
+  kin.Q(l, channel::nQ, in.Q, dQ);
+  std::complex<double> value = channel::projection(in);
+
+  // Every kernel is linear in the Q's so passing their derivatives
+  // instead gives the derivative of the kernel
+  std::copy(dQ, dQ + channel::nQ, in.Q);
+  *dt = channel::projection(in);
+
+  // and the 1 / t^l of the subtractions in t
+  *dt = (*dt - double(l) * value / kin.t) / tl;
+  return value / tl;
 };
 
 // ---------------------------------------------------------------------------
@@ -167,65 +96,129 @@ std::complex<double> Kallen(std::complex<double> x, std::complex<double> y, std:
 };
 
 // ---------------------------------------------------------------------------
-// Kacser function which includes the correct analytic structure of
-// product of breakup momenta, p(s) * q(s)
-std::complex<double> projection_function::psqr()
+// All the invariants at once
+kinematics::kinematics(std::complex<double> xs, double xt, double xmDec2)
+: s(xs), t(xt), mDec2(xmDec2)
 {
-    std::complex<double> result;
-    result = pow(sqrt(s) + mPi, 2.) - mDec2 - ieps;
-    result *= pow(sqrt(s) - mPi, 2.) - mDec2 - ieps;
-    result /= s;
+  std::complex<double> sqs = sqrt(s);
+  pplus  = (sqs + mPi) * (sqs + mPi) - mDec2 - ieps;
+  pminus = (sqs - mPi) * (sqs - mPi) - mDec2 - ieps;
 
-    return result;
-};
+  std::complex<double> lambda = Kallen(s, mPi2, mPi2);
 
-std::complex<double> projection_function::qsqr()
-{
-    std::complex<double> result;
-    result  = Kallen(s, mPi2, mPi2);
-    result /= s;
+  // Kacser function which includes the correct analytic structure of
+  // product of breakup momenta, p(s) * q(s)
+  psqr   = pplus * pminus / s;
+  qsqr   = lambda / s;
+  kacser = sqrt(pplus) * sqrt(pminus) * sqrt(lambda) / s;
 
-    return result;
+  t_minus = (mDec2 + ieps) + mPi2 - (s + mDec2 + ieps - mPi2) / 2. - kacser / 2.;
+  t_plus  = (mDec2 + ieps) + mPi2 - (s + mDec2 + ieps - mPi2) / 2. + kacser / 2.;
+
+  Q_0  = log(t - ieps - t_minus);
+  Q_0 -= log(t - ieps - t_plus);
+  Q_0 /= kacser;
 };
 
-std::complex<double> projection_function::Kacser()
+// ---------------------------------------------------------------------------
+// Angular projection Q kernel functions
+// These are of the form:
+// 1/Kacser(s) * \int_{t_minus}^{t_plus} x^n / (tp - tp - ieps)
+//
+// With the moments m_k = 1/Kacser(s) * \int_{t_minus}^{t_plus} x^k
+// = (t_plus^k + t_plus^(k-1) t_minus + ... + t_minus^k) / (k+1)
+// these satisfy Q_k = t Q_{k-1} - m_{k-1}.
+// Going upwards is stable unless t is far outside the interval of integration,
+// in which case the higher Q's are small and come from large cancellations.
+// There instead the highest Q is summed from its expansion in 1 / t
+// and the recurrence is used downwards.
+// If dt isnt NULL it is filled with the derivatives of the same recurrences
+// with respect to t, so they are exactly the derivatives of the returned Q's
+void kinematics::Q(int first, int number, std::complex<double> * result, std::complex<double> * dt) const
 {
-  std::complex<double> result;
+  int kmax = first + number - 1;
+  double ratio = std::max(std::abs(t_plus), std::abs(t_minus)) / std::abs(t);
 
-  result  = sqrt(pow(sqrt(s) + mPi, 2.) - mDec2 - ieps);
-  result *= sqrt(pow(sqrt(s) - mPi, 2.) - mDec2 - ieps);
-  result *= sqrt(Kallen(s, mPi2, mPi2)) / s;
+  // h_k = (k+1) m_k built up from h_k = t_plus^k + t_minus h_{k-1}
+  std::complex<double> h = xr, tp_k = xr;
+  auto next_h = [&] (int k)
+  {
+    tp_k *= t_plus;
+    h = tp_k + t_minus * h;
+    return h / double(k + 1);
+  };
 
-  return result;
-};
+  // t carries the same ieps as Q_0
+  std::complex<double> tc = t - ieps;
 
-// Ratio of agular momentum barrier factors that are removed when partial wave projecting
-// 1 / p^2(s)
-std::complex<double> projection_function::barrier_ratio(int ell)
-{
-  if (ell == 0)
+  if (kmax <= 2 || ratio > 0.5)
   {
-    return 1.;
+    std::complex<double> Qk = Q_0, dQk = 0.;
+    if (dt != NULL) dQk = (1. / (tc - t_minus) - 1. / (tc - t_plus)) / kacser;
+    for (int k = 0; k <= kmax; k++)
+    {
+      if (k > 0 && dt != NULL) dQk = Qk + t * dQk;
+      if (k == 1) Qk = t * Qk - 1.; // m_0 = 1 exactly
+      if (k > 1)  Qk = t * Qk - next_h(k - 1);
+      if (k >= first)
+      {
+        result[k - first] = Qk;
+        if (dt != NULL) dt[k - first] = dQk;
+      }
+    }
+    return;
   }
-  else
+
+  // Moments m_0, ..., m_kmax, kept on the stack unless l is very large
+  const int n_stack = 32;
+  std::complex<double> m_stack[n_stack];
+  std::vector<std::complex<double>> m_heap;
+  std::complex<double> * m = m_stack;
+  if (kmax + 1 > n_stack)
   {
-    std::complex<double> result;
-    result  = s;
-    result /= pow(sqrt(s) + mPi, 2.) - mDec2 - ieps;
-    result /= pow(sqrt(s) - mPi, 2.) - mDec2 - ieps;
+    m_heap.resize(kmax + 1);
+    m = m_heap.data();
+  }
+  m[0] = xr;
+  for (int k = 1; k <= kmax; k++) m[k] = next_h(k);
+
+  // Q_kmax = sum_j m_{kmax + j} / t^{j+1}
+  std::complex<double> Qk = 0., dQk = 0., term;
+  std::complex<double> tj = 1. / tc;
+  Qk  += m[kmax] * tj;
+  dQk -= m[kmax] * tj / tc;
+  for (int j = 1; j < 200; j++)
+  {
+    tj /= tc;
+    term = next_h(kmax + j) * tj;
+    Qk  += term;
+    dQk -= double(j + 1) * term / tc;
+    if (std::abs(term) < 1.E-16 * std::abs(Qk)) break;
+  }
 
-    return pow(result, xr * double(ell));
+  for (int k = kmax; k >= first; k--)
+  {
+    result[k - first] = Qk;
+    if (dt != NULL) dt[k - first] = dQk;
+    if (k > 0)
+    {
+      Qk  = (Qk + m[k - 1]) / tc;
+      dQk = (dQk - Qk) / tc;
+    }
   }
 };
 
-// ---------------------------------------------------------------------------
-// complex Bounds of integration
-std::complex<double> projection_function::t_minus()
+std::complex<double> kinematics::Q(int k) const
 {
-  return (mDec2 + ieps) + mPi2 - (s + mDec2 + ieps - mPi2) / 2. - Kacser() / 2.;
+  std::complex<double> result;
+  Q(k, 1, &result);
+  return result;
 };
 
-std::complex<double> projection_function::t_plus()
+// ---------------------------------------------------------------------------
+std::complex<double> kinematics::barrier_ratio(int ell) const
 {
-  return (mDec2 + ieps) + mPi2 - (s + mDec2 + ieps - mPi2) / 2. + Kacser() / 2.;
+  if (ell == 0) return 1.;
+
+  return pow(1. / psqr, xr * double(ell));
 };
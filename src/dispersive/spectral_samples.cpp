@@ -0,0 +1,60 @@
+// Samples of the spectral functions rho(s) Q_{jj'}(s,t) of several channels
+// with the same subtractions and decay mass, evaluated together.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#include "dispersive/spectral_samples.hpp"
+
+#include <algorithm>
+
+// ---------------------------------------------------------------------------
+spectral_samples::spectral_samples(std::vector<quantum_numbers*> qns)
+{
+  if (qns.empty())
+  {
+    throw triangle_error("spectral_samples", "no channels given");
+  }
+
+  mDec2 = qns[0]->mDec * qns[0]->mDec;
+  max_power = get_spectral_power(qns[0]->id());
+  for (int i = 0; i < qns.size(); i++)
+  {
+    if (qns[i]->mDec != qns[0]->mDec || qns[i]->n != qns[0]->n || qns[i]->l != qns[0]->l)
+    {
+      throw triangle_error("spectral_samples", "channels must have the same n, l, and mDec");
+    }
+
+    projectors.push_back(projection_function(qns[i]));
+    max_power = std::max(max_power, get_spectral_power(qns[i]->id()));
+  }
+  max_power += qns[0]->l;
+};
+
+// ---------------------------------------------------------------------------
+// Evaluate every channel from the same kinematics and phase space
+const std::complex<double> * spectral_samples::at(double s, double t)
+{
+  if (t != samples_t)
+  {
+    samples.clear();
+    samples_t = t;
+  }
+
+  auto found = samples.find(s);
+  if (found != samples.end()) return &found->second[0];
+
+  kinematics kin(s, t, mDec2);
+  std::complex<double> rho = sqrt(Kallen(s, mPi2, mPi2)) / s;
+
+  std::vector<std::complex<double>> & values = samples[s];
+  values.resize(projectors.size());
+  for (int i = 0; i < projectors.size(); i++)
+  {
+    values[i] = rho * projectors[i].eval(kin);
+  }
+
+  return &values[0];
+};
@@ -0,0 +1,146 @@
+// Interpolation table for the spectral function rho(s) * Q(s,t) so that the
+// dispersion integrals dont need to evaluate the complex logs and square roots
+// at every quadrature node.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#include "dispersive/spectral_table.hpp"
+
+#include <algorithm>
+
+// ---------------------------------------------------------------------------
+// Build the table segment by segment
+void spectral_table::build(std::function<std::complex<double>(double)> f, std::vector<double> points, double tol)
+{
+  segments.clear();
+  rel_tol = tol;
+
+  for (int i = 0; i < points.size() - 1; i++)
+  {
+    segment seg;
+    seg.low = points[i]; seg.high = points[i+1];
+
+    // Start with a coarse uniform grid in u
+    int N0 = 16;
+    std::vector<std::complex<double>> f0(2*N0+1);
+    double scale = 0.;
+    for (int j = 0; j <= 2*N0; j++)
+    {
+      f0[j] = f(s_of_u(seg, double(j) / double(2*N0)));
+      scale += std::abs(f0[j]) / double(2*N0+1);
+    }
+
+    // Absolute floor for the error so zeros of f dont get refined forever
+    // relative to the average size of f over the segment
+    double abs_tol = tol * scale;
+
+    std::map<double, std::complex<double>> nodes;
+    nodes[0.] = f0[0];
+    for (int j = 0; j < N0; j++)
+    {
+      double u0 = double(2*j) / double(2*N0), u1 = double(2*j+2) / double(2*N0);
+      refine(seg, f, u0, f0[2*j], u1, f0[2*j+2], f0[2*j+1], abs_tol, 0, nodes);
+    }
+
+    // Copy over the sorted nodes
+    for (auto node = nodes.begin(); node != nodes.end(); ++node)
+    {
+      seg.u.push_back(node->first);
+      seg.f.push_back(node->second);
+    }
+    spline(seg);
+
+    segments.push_back(seg);
+  }
+};
+
+// ---------------------------------------------------------------------------
+// Adaptive bisection, an interval is accepted when the quadratic through its
+// endpoints and midpoint reproduces the values at the quarter points
+void spectral_table::refine(const segment & seg, std::function<std::complex<double>(double)> & f,
+                            double u0, std::complex<double> f0, double u1, std::complex<double> f1,
+                            std::complex<double> fm, double abs_tol, int depth,
+                            std::map<double, std::complex<double>> & nodes)
+{
+  double um = (u0 + u1) / 2.;
+  double q1 = (u0 + um) / 2., q3 = (um + u1) / 2.;
+
+  std::complex<double> fq1 = f(s_of_u(seg, q1));
+  std::complex<double> fq3 = f(s_of_u(seg, q3));
+
+  double err = std::max(std::abs(fq1 - (3.*f0 + 6.*fm - f1) / 8.),
+                        std::abs(fq3 - (-f0 + 6.*fm + 3.*f1) / 8.));
+  bool converged = (err < std::max(abs_tol, rel_tol * std::abs(fm)));
+  if (converged || depth >= max_depth || nodes.size() >= max_nodes)
+  {
+    nodes[q1] = fq1; nodes[um] = fm; nodes[q3] = fq3; nodes[u1] = f1;
+    return;
+  }
+
+  refine(seg, f, u0, f0, um, fm, fq1, abs_tol, depth+1, nodes);
+  refine(seg, f, um, fm, u1, f1, fq3, abs_tol, depth+1, nodes);
+};
+
+// ---------------------------------------------------------------------------
+// Natural cubic spline on non-uniform nodes (tridiagonal solve)
+void spectral_table::spline(segment & seg)
+{
+  int N = seg.u.size();
+  seg.d2f.assign(N, 0.);
+  if (N < 3) return;
+
+  std::vector<std::complex<double>> c(N, 0.);
+  for (int i = 1; i < N - 1; i++)
+  {
+    double h0 = seg.u[i] - seg.u[i-1], h1 = seg.u[i+1] - seg.u[i];
+    double sig = h0 / (h0 + h1);
+    std::complex<double> p = sig * seg.d2f[i-1] + 2.;
+    seg.d2f[i] = (sig - 1.) / p;
+    c[i] = (seg.f[i+1] - seg.f[i]) / h1 - (seg.f[i] - seg.f[i-1]) / h0;
+    c[i] = (6. * c[i] / (h0 + h1) - sig * c[i-1]) / p;
+  }
+
+  seg.d2f[N-1] = 0.;
+  for (int i = N - 2; i >= 0; i--)
+  {
+    seg.d2f[i] = seg.d2f[i] * seg.d2f[i+1] + c[i];
+  }
+};
+
+// ---------------------------------------------------------------------------
+// Interpolate
+std::complex<double> spectral_table::eval(double s)
+{
+  // Find which segment s is in
+  int i = 0;
+  while (i < segments.size() - 1 && s > segments[i].high) i++;
+  const segment & seg = segments[i];
+
+  double u = u_of_s(seg, s);
+
+  // Bracketing nodes
+  int hi = std::upper_bound(seg.u.begin(), seg.u.end(), u) - seg.u.begin();
+  if (hi == 0) hi = 1;
+  if (hi == seg.u.size()) hi = seg.u.size() - 1;
+  int lo = hi - 1;
+
+  double h = seg.u[hi] - seg.u[lo];
+  double a = (seg.u[hi] - u) / h, b = (u - seg.u[lo]) / h;
+
+  std::complex<double> result;
+  result  = a * seg.f[lo] + b * seg.f[hi];
+  result += ((a*a*a - a) * seg.d2f[lo] + (b*b*b - b) * seg.d2f[hi]) * (h*h) / 6.;
+
+  return result;
+};
+
+// ---------------------------------------------------------------------------
+int spectral_table::size()
+{
+  int N = 0;
+  for (int i = 0; i < segments.size(); i++) N += segments[i].u.size();
+  return N;
+};
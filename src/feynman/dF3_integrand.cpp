@@ -13,148 +13,518 @@
 // Return the value of the integrand in terms of the feynman parameters
 std::complex<double> dF3_integrand::eval(double x, double y, double z)
 {
-    // Store the feynman parameters so to not have to keep passing them
-    update_fparams(x, y, z);
+    double re, im;
+    eval(1, &x, &y, &z, &re, &im);
+    return re + xi * im;
+};
 
-    std::complex<double> result = 0.;
-    
-    // check if theres sufficiently many subtractions applied
-    if (qns->n < 0)
+// ---------------------------------------------------------------------------
+// Return the value of the integrand for a whole block of feynman parameters
+void dF3_integrand::eval(int npt, const double * x, const double * y, const double * z, double * re, double * im)
+{
+    for (int i = 0; i < npt; i++)
     {
-      std::cout << "\nError! Insufficient subtractions!\n";
-      std::cout << "j = " << qns->j << ", j' = " << qns->jp;
-      std::cout << " integral does not converge with n = " << qns->n << " subtractions.";
-      std::cout << " Quitting... \n";
-      exit(0);
+      re[i] = 0.; im[i] = 0.;
     }
 
     // apply the necessary subtractions in s
-    int id = qns->id();
-
+    // with more than one subtraction the rest of the Taylor polynomial
+    // doesnt depend on s and is integrated separately with taylor()
     switch (qns->n)
     {
       // No subtractions
       case 0:
       {
-          return mT(id, s);
-      }
-      // One subtraction
-      case 1:
-      {
-          return mT(id, s) - mT(id, 0.);
+          mT(npt, x, y, z, s, 1., re, im);
+          break;
       }
+      // One or more subtractions
       default:
       {
-        std::cout << "\nError! n = " << qns->n << " times subtracted integrands";
-        std::cout << " not yet implimented. Quitting... \n";
-        exit(0);
+          mT(npt, x, y, z, s,  1., re, im);
+          mT(npt, x, y, z, 0., -1., re, im);
+          break;
       }
     }
 };
 
 // ---------------------------------------------------------------------------
-// Triangle kernels
-// optional bool if True evaluates mT at s = 0
-std::complex<double> dF3_integrand::mT(int id, double _s)
+// Value and derivatives of the integrand for a whole block of feynman parameters
+void dF3_integrand::gradient(int npt, const double * x, const double * y, const double * z, double * out)
 {
-  // Whether or not to evaluate at s or at s = 0
-  denom = denom0 - x*y* _s,  delta = delta0 - x*y* _s;
-
-  auto error = [&] ()
-  {
-      std::cout << "\nError! projection_function:";
-      std::cout << " j = " << std::to_string(qns->j);
-      std::cout << " and j' = " << std::to_string(qns->jp);
-      std::cout << " (code " << std::to_string(qns->id()) << ")";
-      std::cout << " combination not available. Quitting... \n";
-      exit(0);
-  };
+    for (int i = 0; i < 6*npt; i++) out[i] = 0.;
 
-  std::complex<double> result = 0.;
-  switch (id)
-  {
-      // S-wave, scalar exchange
+    // only the unsubtracted term depends on s
+    switch (qns->n)
+    {
+      // No subtractions
       case 0:
       {
-          result = T(0);
+          mT_gradient(npt, x, y, z, s, 1., true, out);
           break;
       }
-
-      // S-wave, vector exchange
-      case 1:
+      // One or more subtractions
+      default:
       {
-          result  = T(1);
-          result += (delta + 2.*_s - mDec2 - 3.*mPi2) * T(0);
+          mT_gradient(npt, x, y, z, s,  1., true, out);
+          mT_gradient(npt, x, y, z, 0., -1., false, out);
           break;
       }
+    }
+};
 
-      // P-wave, scalar exchange
-      case 10:
-      {
-          result = z * T(0);
-          break;
-      };
+// ---------------------------------------------------------------------------
+// Kernels of several channels to evaluate together
+void dF3_integrand::set_channels(const std::vector<int> & ids)
+{
+    std::vector<feynman_kernel> xkernels;
+    for (int i = 0; i < ids.size(); i++)
+    {
+      quantum_numbers x = *qns;
+      x.set_id(ids[i]);
+      check_channel(&x);
+
+      xkernels.push_back(get_feynman_kernel(ids[i]));
+    }
 
-      // P-wave, vector exchange
-      case 11:
+    kernels = xkernels;
+};
+
+// ---------------------------------------------------------------------------
+// Value of the integrand of every channel for a whole block of feynman parameters
+void dF3_integrand::eval_channels(int npt, const double * x, const double * y, const double * z, double * out)
+{
+    for (int i = 0; i < 2*kernels.size()*npt; i++) out[i] = 0.;
+
+    // same subtractions as in eval
+    switch (qns->n)
+    {
+      // No subtractions
+      case 0:
       {
-          result  = (3.*z - 1.) * T(1) / 2.;
-          result += z * (delta + 2.*_s - mDec2 - 3.*mPi2) * T(0);
+          mT_channels(npt, x, y, z, s, 1., out);
           break;
-      };
-
-      // D-wave, scalar exchange
-      case 20: 
+      }
+      // One or more subtractions
+      default:
       {
-          result  = z*z * T(0);
+          mT_channels(npt, x, y, z, s,  1., out);
+          mT_channels(npt, x, y, z, 0., -1., out);
           break;
-      };
+      }
+    }
+};
 
-      case 10000:
-      { 
-          result  = (_s + mDec2 - mPi2) * (T(1) + delta * T(0));
-          result += (_s - mDec2 - mPi2)*(mDec2 - mPi2) * T(0);
-          break;
-      };
+// ---------------------------------------------------------------------------
+// k-th coefficient of the Taylor expansion of mT around s = 0
+// The kernels are polynomials of at most cubic order in s, so their coefficients
+// are recovered from samples at s = 0, h, 2h, 3h. The dimensionally regularized
+// integrals expand as
+// T(0) = sum_m (xy)^m / (denom - ieps)^(m+1) s^m
+// T(1) = 2 log(denom - ieps) - 2 sum_{m > 0} (xy / (denom - ieps))^m s^m / m
+// With d(denom)/dt = z the derivatives with respect to t are
+// dT(0)_m / dt = - (m+1) z T(0)_m / (denom - ieps) and dT(1)_m / dt = 2 z u^m / (denom - ieps)
+void dF3_integrand::taylor(int npt, const double * x, const double * y, const double * z, int k, double * re, double * im, bool dt)
+{
+  double h = mDec2;
 
-      // Omega case
-      case -11111:
-      {
-          result  = - 2. * T(1);
-          break;
-      };
+  std::vector<double> delta0(npt), As(4 * npt), Bs(4 * npt);
+  for (int j = 0; j < 4; j++)
+  {
+    for (int i = 0; i < npt; i++)
+    {
+      delta0[i] = x[i]*(1.-z[i])*mDec2 + y[i]*(1.-z[i])*mPi2 - x[i]*y[i]*double(j)*h;
+    }
+    kernel(npt, z, &delta0[0], double(j)*h, mDec2, &As[j*npt], &Bs[j*npt]);
+  }
 
-      default: error();
+  // Newton forward differences to monomial coefficients in s
+  auto monomials = [&] (const std::vector<double> & f, int i, double * c)
+  {
+    double d1 = f[npt + i] - f[i];
+    double d2 = f[2*npt + i] - 2.*f[npt + i] + f[i];
+    double d3 = f[3*npt + i] - 3.*f[2*npt + i] + 3.*f[npt + i] - f[i];
+    c[0] = f[i];
+    c[1] = (d1 - d2/2. + d3/3.) / h;
+    c[2] = (d2 - d3) / (2.*h*h);
+    c[3] = d3 / (6.*h*h*h);
   };
-  return result;
+
+  for (int i = 0; i < npt; i++)
+  {
+    double cA[4], cB[4];
+    monomials(As, i, cA);
+    monomials(Bs, i, cB);
+
+    std::complex<double> D = z[i]*t + (1.-z[i])*mPi2 - x[i]*z[i]*mDec2 - y[i]*z[i]*mPi2 - ieps;
+    std::complex<double> u = x[i]*y[i] / D;
+
+    std::complex<double> result = 0.;
+    for (int j = 0; j <= std::min(k, 3); j++)
+    {
+      int m = k - j;
+      std::complex<double> T0 = pow(u, double(m)) / D;
+      std::complex<double> T1 = (m == 0) ? 2. * log(D) : - 2. * pow(u, double(m)) / double(m);
+      if (dt)
+      {
+        T1 = 2. * z[i] * pow(u, double(m)) / D;
+        T0 = - double(m + 1) * z[i] * T0 / D;
+      }
+      result += cA[j] * T1 + cB[j] * T0;
+    }
+    result /= 2. * M_PI;
+
+    re[i] = std::real(result);
+    im[i] = std::imag(result);
+  }
 };
 
 // ---------------------------------------------------------------------------
-// Dimensionally regularized integral of divergence order k
-// D is the combined denominators of all the propagators
-std::complex<double> dF3_integrand::T(int ell)
+// Triangle kernels
+// _s is the energy to evaluate at (either s or s = 0 for subtractions)
+void dF3_integrand::mT(int npt, const double * x, const double * y, const double * z, double _s, double sign, double * re, double * im)
 {
-  std::complex<double> result;
-  switch (ell)
+  if (denom.size() < npt)
   {
-    // Convergent
-    case 0:
+    denom.resize(npt); delta.resize(npt);
+    A.resize(npt);     B.resize(npt);
+  }
+
+  // Combined denominators and shifted momenta
+  for (int i = 0; i < npt; i++)
+  {
+    denom[i] = z[i]*t + (1.-z[i])*mPi2 - x[i]*z[i]*mDec2 - y[i]*z[i]*mPi2 - x[i]*y[i]*_s;
+    delta[i] = x[i]*(1.-z[i])*mDec2 + y[i]*(1.-z[i])*mPi2 - x[i]*y[i]*_s;
+  }
+
+  // Spin dependent coefficients
+  kernel(npt, z, &delta[0], _s, mDec2, &A[0], &B[0]);
+
+  // Fold in the dimensionally regularized integrals
+  // T(0) = 1 / (denom - ieps), T(1) = 2 log(denom - ieps)
+  double norm = sign / (2. * M_PI);
+  for (int i = 0; i < npt; i++)
+  {
+    double d2 = denom[i]*denom[i] + EPS*EPS;
+
+    double T0_re = denom[i] / d2, T0_im = EPS / d2;
+    double T1_re = log(d2),       T1_im = 2. * atan2(-EPS, denom[i]);
+
+    re[i] += norm * (A[i] * T1_re + B[i] * T0_re);
+    im[i] += norm * (A[i] * T1_im + B[i] * T0_im);
+  }
+};
+
+// ---------------------------------------------------------------------------
+// Same as mT for every channel in kernels
+// The denominators and T(0), T(1) are only calculated once per point
+void dF3_integrand::mT_channels(int npt, const double * x, const double * y, const double * z, double _s, double sign, double * out)
+{
+  int nch = kernels.size();
+  if (denom.size() < npt)
+  {
+    denom.resize(npt); delta.resize(npt);
+    A.resize(npt);     B.resize(npt);
+  }
+  if (T.size() < 4 * npt) T.resize(4 * npt);
+
+  for (int i = 0; i < npt; i++)
+  {
+    denom[i] = z[i]*t + (1.-z[i])*mPi2 - x[i]*z[i]*mDec2 - y[i]*z[i]*mPi2 - x[i]*y[i]*_s;
+    delta[i] = x[i]*(1.-z[i])*mDec2 + y[i]*(1.-z[i])*mPi2 - x[i]*y[i]*_s;
+
+    double d2 = denom[i]*denom[i] + EPS*EPS;
+    T[4*i]   = denom[i] / d2; T[4*i+1] = EPS / d2;
+    T[4*i+2] = log(d2);       T[4*i+3] = 2. * atan2(-EPS, denom[i]);
+  }
+
+  double norm = sign / (2. * M_PI);
+  for (int c = 0; c < nch; c++)
+  {
+    kernels[c](npt, z, &delta[0], _s, mDec2, &A[0], &B[0]);
+
+    for (int i = 0; i < npt; i++)
     {
-      result = xr / (denom - ieps);
-      break;
+      out[2*nch*i + 2*c]     += norm * (A[i] * T[4*i+2] + B[i] * T[4*i]);
+      out[2*nch*i + 2*c + 1] += norm * (A[i] * T[4*i+3] + B[i] * T[4*i+1]);
     }
-    // linearly divergent in ell^2
-    case 1:
+  }
+};
+
+// ---------------------------------------------------------------------------
+// Triangle kernels and their derivatives
+// With d(denom)/ds = - x y and d(denom)/dt = z
+// dT(0) = - d(denom) T(0)^2 and dT(1) = 2 d(denom) T(0)
+void dF3_integrand::mT_gradient(int npt, const double * x, const double * y, const double * z, double _s, double sign, bool with_ds, double * out)
+{
+  if (denom.size() < npt)
+  {
+    denom.resize(npt); delta.resize(npt);
+    A.resize(npt);     B.resize(npt);
+  }
+
+  for (int i = 0; i < npt; i++)
+  {
+    denom[i] = z[i]*t + (1.-z[i])*mPi2 - x[i]*z[i]*mDec2 - y[i]*z[i]*mPi2 - x[i]*y[i]*_s;
+    delta[i] = x[i]*(1.-z[i])*mDec2 + y[i]*(1.-z[i])*mPi2 - x[i]*y[i]*_s;
+  }
+
+  kernel(npt, z, &delta[0], _s, mDec2, &A[0], &B[0]);
+
+  std::vector<double> dA(npt, 0.), dB(npt, 0.);
+  if (with_ds) kernel_ds(npt, x, y, z, _s, &dA[0], &dB[0]);
+
+  double norm = sign / (2. * M_PI);
+  for (int i = 0; i < npt; i++)
+  {
+    std::complex<double> T0 = 1. / (denom[i] - ieps);
+    std::complex<double> T1 = 2. * log(denom[i] - ieps);
+
+    std::complex<double> value, ds = 0., dt;
+    value = A[i] * T1 + B[i] * T0;
+    if (with_ds) ds = dA[i] * T1 + dB[i] * T0 + x[i]*y[i] * (B[i] * T0 - 2. * A[i]) * T0;
+    dt = z[i] * (2. * A[i] - B[i] * T0) * T0;
+
+    out[6*i]   += norm * std::real(value); out[6*i+1] += norm * std::imag(value);
+    out[6*i+2] += norm * std::real(ds);    out[6*i+3] += norm * std::imag(ds);
+    out[6*i+4] += norm * std::real(dt);    out[6*i+5] += norm * std::imag(dt);
+  }
+};
+
+// ---------------------------------------------------------------------------
+// Central difference of the kernel coefficients in s
+void dF3_integrand::kernel_ds(int npt, const double * x, const double * y, const double * z, double _s, double * dA, double * dB)
+{
+  double h = mDec2;
+
+  std::vector<double> delta_h(npt), Am(npt), Bm(npt);
+  for (int i = 0; i < npt; i++)
+  {
+    delta_h[i] = x[i]*(1.-z[i])*mDec2 + y[i]*(1.-z[i])*mPi2 - x[i]*y[i]*(_s + h);
+  }
+  kernel(npt, z, &delta_h[0], _s + h, mDec2, dA, dB);
+
+  for (int i = 0; i < npt; i++) delta_h[i] += 2. * x[i]*y[i]*h;
+  kernel(npt, z, &delta_h[0], _s - h, mDec2, &Am[0], &Bm[0]);
+
+  for (int i = 0; i < npt; i++)
+  {
+    dA[i] = (dA[i] - Am[i]) / (2.*h);
+    dB[i] = (dB[i] - Bm[i]) / (2.*h);
+  }
+};
+
+// ---------------------------------------------------------------------------
+// Integrand at fixed x with the y integral done analytically
+std::complex<double> dF3_integrand::eval_inner(double x)
+{
+    switch (qns->n)
+    {
+      // No subtractions
+      case 0:
+      {
+          return mT_inner(x, s);
+      }
+      // One or more subtractions, see eval above
+      default:
+      {
+          return mT_inner(x, s) - mT_inner(x, 0.);
+      }
+    }
+};
+
+std::complex<double> dF3_integrand::eval_inner(double x, std::complex<double> & ds, std::complex<double> & dt)
+{
+    switch (qns->n)
+    {
+      // No subtractions
+      case 0:
+      {
+          return mT_inner(x, s, &ds, &dt);
+      }
+      // One or more subtractions, only the first term depends on s
+      default:
+      {
+          std::complex<double> dt0, result;
+          result = mT_inner(x, s, &ds, &dt) - mT_inner(x, 0., NULL, &dt0);
+          dt -= dt0;
+          return result;
+      }
+    }
+};
+
+// ---------------------------------------------------------------------------
+// int_0^{1-x} dy mT(x, y)
+// In terms of w = y / (1 - x) the combined denominator is
+// denom - ieps = a (1-x)^2 (w - rho1) (w - rho2)
+// and the coefficients A and B are cubic polynomials in w, so everything reduces
+// to moments of 1 / (w - rho) and log(w - rho)
+// Everything depends on t only through the roots rho, and on s through the roots
+// and the coefficients A and B, so the derivatives follow from the chain rule
+std::complex<double> dF3_integrand::mT_inner(double x, double _s, std::complex<double> * ds, std::complex<double> * dt)
+{
+  double Y = 1. - x;
+
+  // Coefficients of the denominator in y
+  double a = mPi2;
+  double b = - t + x * (mDec2 + mPi2 - _s);
+  std::complex<double> c = (1.-x)*t + x*mPi2 - x*(1.-x)*mDec2 - ieps;
+
+  // Roots in w
+  std::complex<double> disc = sqrt(b*b - 4.*a*c);
+  std::complex<double> rho1 = (-b + disc) / (2.*a*Y);
+  std::complex<double> rho2 = (-b - disc) / (2.*a*Y);
+
+  // Recover the polynomial coefficients of A and B in w
+  // by sampling the kernel at w = 0, 1/3, 2/3, 1
+  double xs[4], ys[4], zs[4];
+  for (int i = 0; i < 4; i++)
+  {
+    xs[i] = x; ys[i] = Y * double(i) / 3.; zs[i] = 1. - xs[i] - ys[i];
+  }
+  if (delta.size() < 4)
+  {
+    denom.resize(4); delta.resize(4);
+    A.resize(4);     B.resize(4);
+  }
+  for (int i = 0; i < 4; i++)
+  {
+    delta[i] = xs[i]*(1.-zs[i])*mDec2 + ys[i]*(1.-zs[i])*mPi2 - xs[i]*ys[i]*_s;
+  }
+  kernel(4, zs, &delta[0], _s, mDec2, &A[0], &B[0]);
+
+  // Forward differences to monomial coefficients
+  auto monomials = [] (const std::vector<double> & f, double * c)
+  {
+    double d1 = f[1] - f[0];
+    double d2 = f[2] - 2.*f[1] + f[0];
+    double d3 = f[3] - 3.*f[2] + 3.*f[1] - f[0];
+    c[0] = f[0];
+    c[1] = 3.  * (d1 - d2/2. + d3/3.);
+    c[2] = 9.  * (d2 - d3) / 2.;
+    c[3] = 27. * d3 / 6.;
+  };
+  double cA[4], cB[4];
+  monomials(A, cA);
+  monomials(B, cB);
+
+  // Same for the s-derivatives of A and B
+  double dcA[4] = {0., 0., 0., 0.}, dcB[4] = {0., 0., 0., 0.};
+  if (ds != NULL)
+  {
+    std::vector<double> dA(4), dB(4);
+    kernel_ds(4, xs, ys, zs, _s, &dA[0], &dB[0]);
+    monomials(dA, dcA);
+    monomials(dB, dcB);
+  }
+
+  // Branch of the log: log(denom - ieps) differs from the sum of the logs
+  // of its factors by a constant multiple of 2 pi i along the real w line
+  double wm = 0.5;
+  std::complex<double> log_denom = log(a*wm*wm*Y*Y + b*wm*Y + c);
+  std::complex<double> log_sum   = log(a*Y*Y) + log(wm - rho1) + log(wm - rho2);
+  double n_branch = std::round(std::imag(log_denom - log_sum) / (2.*M_PI));
+
+  // Derivatives of the roots from a Y^2 rho^2 + b Y rho + c = 0
+  // with db/ds = -x, dc/ds = 0 and db/dt = -1, dc/dt = 1 - x
+  auto droot = [&] (std::complex<double> rho, double sign, double db, double dc)
+  {
+    return - sign * (Y * rho * db + dc) / (Y * disc);
+  };
+  std::complex<double> ds_rho1 = droot(rho1, 1., -x, 0.),  ds_rho2 = droot(rho2, -1., -x, 0.);
+  std::complex<double> dt_rho1 = droot(rho1, 1., -1., Y),  dt_rho2 = droot(rho2, -1., -1., Y);
+
+  std::complex<double> result = 0., ds_result = 0., dt_result = 0.;
+  for (int m = 0; m < 4; m++)
+  {
+    // T(0) term
+    if (cB[m] != 0. || dcB[m] != 0.)
     {
-      result = 2. * log(denom - ieps);
-      break;
+      std::complex<double> moment = (J(m, rho1) - J(m, rho2)) / (rho1 - rho2);
+      result += cB[m] * moment / (a * Y);
+
+      if (ds != NULL || dt != NULL)
+      {
+        std::complex<double> d1 = (dJ(m, rho1) - moment) / (rho1 - rho2);
+        std::complex<double> d2 = (moment - dJ(m, rho2)) / (rho1 - rho2);
+        ds_result += (dcB[m] * moment + cB[m] * (d1 * ds_rho1 + d2 * ds_rho2)) / (a * Y);
+        dt_result += cB[m] * (d1 * dt_rho1 + d2 * dt_rho2) / (a * Y);
+      }
     }
-    default:
+
+    // T(1) term
+    if (cA[m] != 0. || dcA[m] != 0.)
     {
-      std::cout << "\nError! Feynman integrand T of divergence order l =" << ell;
-      std::cout << " not yet implimented. Quitting... \n";
-      exit(0);
+      std::complex<double> L;
+      L  = log(a*Y*Y) + 2.*M_PI*xi*n_branch;
+      L += log(1. - rho1) - J(m+1, rho1);
+      L += log(1. - rho2) - J(m+1, rho2);
+      L /= double(m + 1);
+      result += cA[m] * 2. * Y * L;
+
+      // dL / drho = - J(m, rho)
+      if (ds != NULL || dt != NULL)
+      {
+        std::complex<double> J1 = J(m, rho1), J2 = J(m, rho2);
+        ds_result += 2. * Y * (dcA[m] * L - cA[m] * (J1 * ds_rho1 + J2 * ds_rho2));
+        dt_result -= 2. * Y * cA[m] * (J1 * dt_rho1 + J2 * dt_rho2);
+      }
     }
   }
+
+  if (ds != NULL) *ds = ds_result / (2. * M_PI);
+  if (dt != NULL) *dt = dt_result / (2. * M_PI);
+
   return result / (2. * M_PI);
-}
+};
+
+// ---------------------------------------------------------------------------
+// Moments int_0^1 dw w^m / (w - rho)
+// far away from the interval the expansion in 1 / rho avoids large cancellations
+std::complex<double> dF3_integrand::J(int m, std::complex<double> rho)
+{
+  std::complex<double> result = 0.;
+
+  if (std::abs(rho) > 2.)
+  {
+    std::complex<double> rhoj = 1. / rho;
+    for (int j = 0; j < 60; j++)
+    {
+      result -= rhoj / double(m + j + 1);
+      rhoj /= rho;
+    }
+    return result;
+  }
+
+  std::complex<double> rhok = 1.;
+  for (int k = m - 1; k >= 0; k--)
+  {
+    result += rhok / double(k + 1);
+    rhok *= rho;
+  }
+  result += rhok * (log(1. - rho) - log(-rho));
+
+  return result;
+};
+
+// ---------------------------------------------------------------------------
+// int_0^1 dw w^m / (w - rho)^2 by parts
+// = - 1 / (1 - rho) - delta_{m0} / rho + m J(m-1, rho)
+std::complex<double> dF3_integrand::dJ(int m, std::complex<double> rho)
+{
+  std::complex<double> result = - 1. / (1. - rho);
+  if (m == 0) return result - 1. / rho;
+
+  return result + double(m) * J(m - 1, rho);
+};
+
+// ---------------------------------------------------------------------------
+// Pick out the kernel for the channel given by qns
+// throws a triangle_error if the channel isnt available
+void dF3_integrand::set_kernel()
+{
+  check_channel(qns);
+
+  kernel_id = qns->id();
+  kernel = get_feynman_kernel(kernel_id);
+};
@@ -0,0 +1,143 @@
+// Feynman evaluation of several spin channels at the same s, t, and decay mass.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#include "feynman/feynman_channels.hpp"
+
+#include <algorithm>
+
+// ---------------------------------------------------------------------------
+feynman_channels::feynman_channels(quantum_numbers * xqn, std::vector<int> xids, accuracy_policy xpol)
+: ids(xids), policy(xpol)
+{
+  if (ids.empty())
+  {
+    throw triangle_error("feynman_channels", "no channels given");
+  }
+
+  for (int i = 0; i < ids.size(); i++)
+  {
+    quantum_numbers * x = new quantum_numbers(*xqn);
+    x->set_id(ids[i]);
+    qns.push_back(x);
+  }
+
+  try
+  {
+    for (int i = 0; i < ids.size(); i++)
+    {
+      amps.push_back(new feynman_triangle(qns[i], xpol));
+    }
+
+    integrand = new dF3_integrand(qns[0]);
+    integrand->set_channels(ids);
+  }
+  catch (...)
+  {
+    clear();
+    throw;
+  }
+};
+
+// ---------------------------------------------------------------------------
+void feynman_channels::clear()
+{
+  for (int i = 0; i < amps.size(); i++) delete amps[i];
+  for (int i = 0; i < qns.size(); i++)  delete qns[i];
+  delete integrand;
+  amps.clear(); qns.clear(); integrand = NULL;
+};
+
+// ---------------------------------------------------------------------------
+// Integrate all channels with one call to hcubature_v with fdim = 2 * channels
+std::vector<std::complex<double>> feynman_channels::eval(double s, double t)
+{
+  KT_RESET(info);
+  KT_TIME(info.feynman_time);
+
+  int nch = ids.size();
+  std::vector<double> val(2*nch), error(2*nch);
+
+  double min[2] = {0., 0.};
+  double max[2] = {1., 1.};
+
+  integrand->set_energies(s, t);
+  hcubature_v(2*nch, wrapped_integrand, this, 2, min, max, policy.cubature_max_evals, 0, policy.cubature_tol, ERROR_INDIVIDUAL, &val[0], &error[0]);
+
+  err = 0.;
+  std::vector<std::complex<double>> result(nch);
+  for (int i = 0; i < nch; i++)
+  {
+    // Factor of 2 from the normalization of dF_3 integration measure
+    result[i] = 2. * (val[2*i] + xi * val[2*i+1]);
+    double error_i = 2. * sqrt(error[2*i]*error[2*i] + error[2*i+1]*error[2*i+1]);
+
+    // Remove the rest of the Taylor polynomial for more than one subtraction
+    if (qns[i]->n > 1)
+    {
+      double taylor_err;
+      result[i] -= amps[i]->taylor_polynomial(s, t, &taylor_err);
+      error_i += taylor_err;
+    }
+
+    err = std::max(err, error_i);
+  }
+
+  return result;
+};
+
+// ---------------------------------------------------------------------------
+// Evaluate a whole grid of s values at fixed t, point by point
+std::vector<std::vector<std::complex<double>>> feynman_channels::eval(const std::vector<double> & s, double t)
+{
+  double max_err = 0.;
+  std::vector<std::vector<std::complex<double>>> result(ids.size(), std::vector<std::complex<double>>(s.size()));
+  for (int k = 0; k < s.size(); k++)
+  {
+    std::vector<std::complex<double>> values = eval(s[k], t);
+    for (int i = 0; i < ids.size(); i++) result[i][k] = values[i];
+    max_err = std::max(max_err, err);
+  }
+  err = max_err;
+
+  return result;
+};
+
+// ---------------------------------------------------------------------------
+// Wrapper for the integrand of all channels to fit into hcubature_v
+// in[2*i], in[2*i+1] are the integration variables of the i-th point
+// and fval[fdim*i], ..., fval[fdim*i + fdim-1] the components of all channels
+int feynman_channels::wrapped_integrand(unsigned ndim, size_t npt, const double *in, void *fdata, unsigned fdim, double *fval)
+{
+  feynman_channels* tri = (feynman_channels *) fdata;
+
+  KT_COUNT(tri->info.feynman_calls, npt);
+  KT_COUNT(tri->info.cubature_batches, 1);
+  KT_COUNT(tri->info.cubature_regions, npt / 17);
+
+  if (tri->x.size() < npt)
+  {
+    tri->x.resize(npt); tri->y.resize(npt); tri->z.resize(npt);
+  }
+  if (tri->out.size() < fdim * npt) tri->out.resize(fdim * npt);
+
+  for (int i = 0; i < npt; i++)
+  {
+    tri->x[i] = in[2*i] * in[2*i+1];
+    tri->y[i] = in[2*i] * (1. - in[2*i+1]);
+    tri->z[i] = 1. - tri->x[i] - tri->y[i];
+  }
+
+  tri->integrand->eval_channels(npt, &tri->x[0], &tri->y[0], &tri->z[0], &tri->out[0]);
+
+  // Include the jacobian
+  for (int i = 0; i < npt; i++)
+  {
+    for (int j = 0; j < fdim; j++) fval[fdim*i+j] = in[2*i] * tri->out[fdim*i+j];
+  }
+
+  return 0;
+};
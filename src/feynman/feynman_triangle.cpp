@@ -10,47 +10,317 @@
 
 #include "feynman/feynman_triangle.hpp"
 
+#include <unordered_map>
+
 // ---------------------------------------------------------------------------
 // Evaluate the triangle assuming a fixed mass exchange with mass t
 std::complex<double> feynman_triangle::eval(double s, double t)
+{
+    KT_RESET(info);
+
+    std::complex<double> result;
+    if (cache != NULL && cache->find(key(s, t), result, &err)) return result;
+
+    // Fix the "masses" s and t
+    integrand.set_energies(s, t);
+
+    {
+      KT_TIME(info.feynman_time);
+      result = (analytic) ? eval_analytic() : eval_cubature();
+
+      // Remove the rest of the Taylor polynomial for more than one subtraction
+      if (qns->n > 1)
+      {
+        double error;
+        result -= taylor_polynomial(s, t, &error);
+        err += error;
+      }
+    }
+
+    if (cache != NULL) cache->store(key(s, t), result, err);
+
+    return result;
+};
+
+// ---------------------------------------------------------------------------
+// Rest of the Taylor polynomial around s = 0 for n > 1 subtractions
+std::complex<double> feynman_triangle::taylor_polynomial(double s, double t, double * error)
+{
+    std::complex<double> result = 0.;
+    if (error != NULL) *error = 0.;
+    if (qns->n < 2) return result;
+
+    if (!taylor_saved(t))
+    {
+      integrand.set_energies(s, t);
+      set_taylor(t);
+    }
+
+    for (int k = 1; k < qns->n; k++)
+    {
+      result += pow(s, double(k)) * taylor[k-1];
+      if (error != NULL) *error += std::abs(pow(s, double(k))) * taylor_err;
+    }
+
+    return result;
+};
+
+// ---------------------------------------------------------------------------
+// Evaluate a whole grid of s values at fixed t, point by point
+std::vector<std::complex<double>> feynman_triangle::eval(const std::vector<double> & s, double t)
+{
+    double max_err = 0.;
+    std::vector<std::complex<double>> result(s.size());
+    for (int i = 0; i < s.size(); i++)
+    {
+      result[i] = eval(s[i], t);
+      max_err = std::max(max_err, err);
+    }
+    err = max_err;
+
+    return result;
+};
+
+// ---------------------------------------------------------------------------
+// Evaluate the triangle and its derivatives in s and t
+// These are not saved to the persistent cache
+triangle_gradient feynman_triangle::eval_gradient(double s, double t)
+{
+    KT_RESET(info);
+
+    integrand.set_energies(s, t);
+
+    KT_TIME(info.feynman_time);
+    triangle_gradient result = (analytic) ? gradient_analytic() : gradient_cubature();
+
+    // Remove the rest of the Taylor polynomial for more than one subtraction
+    if (qns->n > 1)
+    {
+      if (!taylor_saved(t) || taylor_dt.empty()) set_taylor(t, true);
+
+      for (int k = 1; k < qns->n; k++)
+      {
+        result.value -= pow(s, double(k)) * taylor[k-1];
+        result.ds    -= double(k) * pow(s, double(k-1)) * taylor[k-1];
+        result.dt    -= pow(s, double(k)) * taylor_dt[k-1];
+        err += std::abs(pow(s, double(k))) * taylor_err;
+        result.ds_err += double(k) * std::abs(pow(s, double(k-1))) * taylor_err;
+        result.dt_err += std::abs(pow(s, double(k))) * taylor_dt_err;
+      }
+    }
+
+    return result;
+};
+
+// ---------------------------------------------------------------------------
+// Integrate over both feynman parameters numerically
+std::complex<double> feynman_triangle::eval_cubature()
 {
     // Desination for the result and assosiated errors
-    double val[2], err[2];
+    double val[2], error[2];
 
     // Integrate both x and y from 0 to 1
     double min[2] = {0., 0.};
     double max[2] = {1., 1.};
 
-    // Fix the "masses" s and t
-    integrand.set_energies(s, t);
-
-    // TODO: Set relative errors and max calls to actual good values
     // Integrate over x and y
-    hcubature(2, wrapped_integrand, &integrand, 2, min, max, 2E7, 0, 1e-3, ERROR_INDIVIDUAL, val, err);
+    hcubature_v(2, wrapped_integrand, this, 2, min, max, policy.cubature_max_evals, 0, policy.cubature_tol, ERROR_INDIVIDUAL, val, error);
 
     // Assemble the result as a complex double
     std::complex<double> result = val[0] + xi * val[1];
     result *= 2.; // Factor of 2 from the normalization of dF_3 integration measure
+    err = 2. * sqrt(error[0]*error[0] + error[1]*error[1]);
 
     return result;
 };
 
 // ---------------------------------------------------------------------------
-// Wrapper for the feynman parameter integrands to fit into hcubature
-int feynman_triangle::wrapped_integrand(unsigned ndim, const double *in, void *fdata, unsigned fdim, double *fval)
+// Only integrate over x numerically, the y integral is done analytically
+std::complex<double> feynman_triangle::eval_analytic()
 {
-  dF3_integrand* integrand = (dF3_integrand *) fdata;
+    auto dx = [&](double x)
+    {
+      KT_COUNT(info.feynman_calls, 1);
+      return integrand.eval_inner(x);
+    };
+
+    err = 0.;
+    std::complex<double> result;
+    result = gk_integrate(dx, 0., 1., analytic_policy(), err);
+    result *= 2.; // Factor of 2 from the normalization of dF_3 integration measure
+    err *= 2.;
+
+    return result;
+};
+
+// ---------------------------------------------------------------------------
+// Value and derivatives as six components of the same cubature
+triangle_gradient feynman_triangle::gradient_cubature()
+{
+    double val[6], error[6];
+
+    double min[2] = {0., 0.};
+    double max[2] = {1., 1.};
+
+    hcubature_v(6, wrapped_gradient, this, 2, min, max, policy.cubature_max_evals, 0, policy.cubature_tol, ERROR_INDIVIDUAL, val, error);
+
+    triangle_gradient result;
+    result.value = 2. * (val[0] + xi * val[1]);
+    result.ds    = 2. * (val[2] + xi * val[3]);
+    result.dt    = 2. * (val[4] + xi * val[5]);
+    err = 2. * sqrt(error[0]*error[0] + error[1]*error[1]);
+    result.ds_err = 2. * sqrt(error[2]*error[2] + error[3]*error[3]);
+    result.dt_err = 2. * sqrt(error[4]*error[4] + error[5]*error[5]);
+
+    return result;
+};
+
+// ---------------------------------------------------------------------------
+// The value and derivatives of the inner integral come together at each x
+// and are saved so the three integrals over x share the same nodes
+triangle_gradient feynman_triangle::gradient_analytic()
+{
+    std::unordered_map<double, triangle_gradient> nodes;
+    auto at = [&](double x) -> const triangle_gradient &
+    {
+      auto found = nodes.find(x);
+      if (found != nodes.end()) return found->second;
+
+      KT_COUNT(info.feynman_calls, 1);
+      triangle_gradient & g = nodes[x];
+      g.value = integrand.eval_inner(x, g.ds, g.dt);
+      return g;
+    };
+
+    auto dx    = [&](double x){ return at(x).value; };
+    auto dx_ds = [&](double x){ return at(x).ds; };
+    auto dx_dt = [&](double x){ return at(x).dt; };
+
+    err = 0.;
+    triangle_gradient result;
+    accuracy_policy adaptive = analytic_policy();
+    result.value = 2. * gk_integrate(dx,    0., 1., adaptive, err);
+    result.ds    = 2. * gk_integrate(dx_ds, 0., 1., adaptive, result.ds_err);
+    result.dt    = 2. * gk_integrate(dx_dt, 0., 1., adaptive, result.dt_err);
+    err *= 2.; result.ds_err *= 2.; result.dt_err *= 2.;
+
+    return result;
+};
+
+// ---------------------------------------------------------------------------
+// Integrate the Taylor coefficients of the integrand around s = 0
+// with the same parameterization of the feynman parameters as eval_cubature
+void feynman_triangle::set_taylor(double t, bool dt)
+{
+    taylor.clear(); taylor_dt.clear();
+    taylor_err = 0.; taylor_dt_err = 0.;
+
+    for (int k = 1; k < qns->n; k++)
+    {
+      // Largest error of the inner integrals, which bounds their contribution
+      // to the error of the outer integral over a unit interval
+      double inner_err = 0.;
+      auto da = [&](double a, bool d)
+      {
+        auto db = [&](double b)
+        {
+          double x = a * b, y = a * (1. - b), z = 1. - a;
+          double re, im;
+          integrand.taylor(1, &x, &y, &z, k, &re, &im, d);
+          return a * (re + xi * im);
+        };
+
+        double error = 0.;
+        std::complex<double> inner = gk_integrate(db, 0., 1., policy, error);
+        inner_err = std::max(inner_err, error);
+        return inner;
+      };
+
+      double error = 0.;
+      taylor.push_back(2. * gk_integrate([&](double a){ return da(a, false); }, 0., 1., policy, error));
+      taylor_err = std::max(taylor_err, 2. * (error + inner_err));
+
+      if (!dt) continue;
+      double dt_error = 0.;
+      inner_err = 0.;
+      taylor_dt.push_back(2. * gk_integrate([&](double a){ return da(a, true); }, 0., 1., policy, dt_error));
+      taylor_dt_err = std::max(taylor_dt_err, 2. * (dt_error + inner_err));
+    }
+
+    taylor_t = t;
+    taylor_n = qns->n; taylor_l = qns->l; taylor_id = qns->id();
+};
+
+// ---------------------------------------------------------------------------
+// Wrapper for the feynman parameter integrands to fit into hcubature_v
+// in[2*i], in[2*i+1] are the integration variables of the i-th point
+int feynman_triangle::wrapped_integrand(unsigned ndim, size_t npt, const double *in, void *fdata, unsigned fdim, double *fval)
+{
+  feynman_triangle* tri = (feynman_triangle *) fdata;
+
+  KT_COUNT(tri->info.feynman_calls, npt);
+  KT_COUNT(tri->info.cubature_batches, 1);
+  KT_COUNT(tri->info.cubature_regions, npt / 17);
+
+  if (tri->x.size() < npt)
+  {
+    tri->x.resize(npt);  tri->y.resize(npt);  tri->z.resize(npt);
+    tri->re.resize(npt); tri->im.resize(npt);
+  }
 
   // Feynman parameters
-  double x = in[0] * in[1];
-  double y = in[0] * (1. - in[1]);
-  double z = 1. - x - y;
+  for (int i = 0; i < npt; i++)
+  {
+    tri->x[i] = in[2*i] * in[2*i+1];
+    tri->y[i] = in[2*i] * (1. - in[2*i+1]);
+    tri->z[i] = 1. - tri->x[i] - tri->y[i];
+  }
 
-  std::complex<double> result = in[0] * integrand->eval(x, y, z);
+  tri->integrand.eval(npt, &tri->x[0], &tri->y[0], &tri->z[0], &tri->re[0], &tri->im[0]);
 
   // Split up the real andi imaginary parts to get them out
-  fval[0] = std::real(result);
-  fval[1] = std::imag(result);
+  // including the jacobian
+  for (int i = 0; i < npt; i++)
+  {
+    fval[2*i]   = in[2*i] * tri->re[i];
+    fval[2*i+1] = in[2*i] * tri->im[i];
+  }
+
+  return 0;
+};
+
+// ---------------------------------------------------------------------------
+// Same for the value and derivatives, in[2*i], in[2*i+1] are the integration
+// variables of the i-th point and fval[6*i], ..., fval[6*i+5] the components
+int feynman_triangle::wrapped_gradient(unsigned ndim, size_t npt, const double *in, void *fdata, unsigned fdim, double *fval)
+{
+  feynman_triangle* tri = (feynman_triangle *) fdata;
+
+  KT_COUNT(tri->info.feynman_calls, npt);
+  KT_COUNT(tri->info.cubature_batches, 1);
+  KT_COUNT(tri->info.cubature_regions, npt / 17);
+
+  if (tri->x.size() < npt)
+  {
+    tri->x.resize(npt);  tri->y.resize(npt);  tri->z.resize(npt);
+    tri->re.resize(npt); tri->im.resize(npt);
+  }
+  if (tri->grad.size() < 6 * npt) tri->grad.resize(6 * npt);
+
+  for (int i = 0; i < npt; i++)
+  {
+    tri->x[i] = in[2*i] * in[2*i+1];
+    tri->y[i] = in[2*i] * (1. - in[2*i+1]);
+    tri->z[i] = 1. - tri->x[i] - tri->y[i];
+  }
+
+  tri->integrand.gradient(npt, &tri->x[0], &tri->y[0], &tri->z[0], &tri->grad[0]);
+
+  // Include the jacobian
+  for (int i = 0; i < npt; i++)
+  {
+    for (int j = 0; j < 6; j++) fval[6*i+j] = in[2*i] * tri->grad[6*i+j];
+  }
 
-  return 0.;
+  return 0;
 };
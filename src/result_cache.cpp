@@ -0,0 +1,242 @@
+// Persistent cache of evaluated triangle amplitudes so the same points dont
+// have to be recalculated between fit iterations or different jobs.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#include "result_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------
+// FNV-1a hash of all the parameters
+uint64_t cache_key::hash() const
+{
+  uint64_t result = 14695981039346656037ULL;
+
+  auto add = [&] (const void * data, size_t size)
+  {
+    const unsigned char * bytes = (const unsigned char *) data;
+    for (size_t i = 0; i < size; i++)
+    {
+      result ^= bytes[i];
+      result *= 1099511628211ULL;
+    }
+  };
+
+  add(&id, sizeof(id));     add(&n, sizeof(n));
+  add(&l, sizeof(l));       add(&method, sizeof(method));
+  add(&order, sizeof(order)); add(&limit, sizeof(limit));
+  add(&revision, sizeof(revision));
+  add(&mDec, sizeof(mDec)); add(&s, sizeof(s));
+  add(&t, sizeof(t));       add(&tol, sizeof(tol));
+  add(&sub_tol, sizeof(sub_tol));
+
+  return result;
+};
+
+// ---------------------------------------------------------------------------
+// Open the file and write the header if its new
+result_cache::result_cache(std::string file)
+: filename(file)
+{
+  fd = open(filename.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd < 0)
+  {
+    std::cout << "\nWarning! result_cache: cannot open " << filename << ". Caching disabled.\n";
+    return;
+  }
+
+  flock(fd, LOCK_EX);
+  struct stat st;
+  fstat(fd, &st);
+
+  // Writes of whole records are atomic under the lock, so anything left over
+  // is from a writer killed mid-record (or mid-header) and is dropped so that
+  // the records appended after it stay aligned
+  // Files which arent compatible caches are left alone for refresh to reject
+  header head;
+  std::memset(&head, 0, sizeof(head));
+  size_t size = st.st_size;
+  size_t got  = pread(fd, &head, std::min(size, sizeof(head)), 0);
+  bool ours   = (got == std::min(size, sizeof(head))) && (std::strncmp(head.magic, "KTTRI", std::min(got, (size_t) 5)) == 0);
+  if (got >= sizeof(head)) ours = ours && (head.version == version) && (head.record_size == sizeof(record));
+
+  size_t whole = (size < sizeof(header)) ? 0 : sizeof(header) + (size - sizeof(header)) / sizeof(record) * sizeof(record);
+  if (ours && whole != size)
+  {
+    std::cout << "\nWarning! result_cache: dropping an incomplete record at the end of " << filename << ".\n";
+    if (ftruncate(fd, whole) != 0)
+    {
+      std::cout << "\nWarning! result_cache: cannot truncate " << filename << ". Caching disabled.\n";
+      flock(fd, LOCK_UN);
+      close(fd); fd = -1;
+      return;
+    }
+    st.st_size = whole;
+  }
+
+  if (st.st_size == 0)
+  {
+    std::memset(&head, 0, sizeof(head));
+    std::strncpy(head.magic, "KTTRI", sizeof(head.magic));
+    head.version = version;
+    head.record_size = sizeof(record);
+    if (write(fd, &head, sizeof(head)) != sizeof(head))
+    {
+      std::cout << "\nWarning! result_cache: cannot write to " << filename << ". Caching disabled.\n";
+      close(fd); fd = -1;
+    }
+  }
+  if (fd >= 0) flock(fd, LOCK_UN);
+
+  refresh();
+};
+
+result_cache::~result_cache()
+{
+  if (map != NULL) munmap((void *) map, map_size);
+  if (fd >= 0) close(fd);
+};
+
+// ---------------------------------------------------------------------------
+// Map any new records written since the last time
+void result_cache::refresh()
+{
+  if (fd < 0) return;
+
+  flock(fd, LOCK_SH);
+  struct stat st;
+  fstat(fd, &st);
+  size_t size = st.st_size;
+
+  if (size == map_size)
+  {
+    flock(fd, LOCK_UN);
+    return;
+  }
+
+  if (map != NULL) munmap((void *) map, map_size);
+  map = (const char *) mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  flock(fd, LOCK_UN);
+
+  if (map == MAP_FAILED)
+  {
+    std::cout << "\nWarning! result_cache: cannot map " << filename << ". Caching disabled.\n";
+    map = NULL; map_size = 0;
+    close(fd); fd = -1;
+    return;
+  }
+  map_size = size;
+
+  // Check the file is one of ours and in the current format
+  const header * head = (const header *) map;
+  if (map_size < sizeof(header) || std::strncmp(head->magic, "KTTRI", 5) != 0
+      || head->version != version || head->record_size != sizeof(record))
+  {
+    std::cout << "\nWarning! result_cache: " << filename << " is not a compatible cache. Caching disabled.\n";
+    munmap((void *) map, map_size);
+    map = NULL; map_size = 0;
+    close(fd); fd = -1;
+    return;
+  }
+
+  // Only index complete records
+  size_t n_records = (map_size - sizeof(header)) / sizeof(record);
+  const record * records = (const record *) (map + sizeof(header));
+  for (size_t i = n_indexed; i < n_records; i++)
+  {
+    index.insert(std::make_pair(records[i].hash, i));
+  }
+  n_indexed = n_records;
+};
+
+// ---------------------------------------------------------------------------
+bool result_cache::find(const cache_key & key, std::complex<double> & value, double * error)
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  if (fd < 0) return false;
+
+  uint64_t hash = key.hash();
+
+  // Look in what is already mapped and otherwise check for new records
+  for (int attempt = 0; attempt < 2; attempt++)
+  {
+    const record * records = (const record *) (map + sizeof(header));
+    auto range = index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+      const record & rec = records[it->second];
+
+      // Make sure this isnt a hash collision
+      bool same = (rec.id == key.id) && (rec.n == key.n) && (rec.l == key.l) && (rec.method == key.method)
+               && (rec.order == key.order) && (rec.limit == key.limit) && (rec.revision == key.revision)
+               && (rec.mDec == key.mDec) && (rec.s == key.s) && (rec.t == key.t) && (rec.tol == key.tol)
+               && (rec.sub_tol == key.sub_tol);
+
+      if (same)
+      {
+        value = rec.re + xi * rec.im;
+        if (error != NULL) *error = rec.error;
+        return true;
+      }
+    }
+
+    if (attempt == 0) refresh();
+  }
+
+  return false;
+};
+
+// ---------------------------------------------------------------------------
+void result_cache::store(const cache_key & key, std::complex<double> value, double error)
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  if (fd < 0) return;
+
+  record rec;
+  std::memset(&rec, 0, sizeof(rec));
+  rec.hash = key.hash();
+  rec.id = key.id; rec.n = key.n; rec.l = key.l; rec.method = key.method;
+  rec.order = key.order; rec.limit = key.limit; rec.revision = key.revision;
+  rec.mDec = key.mDec; rec.s = key.s; rec.t = key.t; rec.tol = key.tol;
+  rec.sub_tol = key.sub_tol;
+  rec.re = std::real(value); rec.im = std::imag(value); rec.error = error;
+
+  // Whole records are appended at once under an exclusive lock
+  // A partial record would misalign every record appended after it, so the file
+  // is cut back to where it was and nothing more is written to it
+  flock(fd, LOCK_EX);
+  struct stat st;
+  fstat(fd, &st);
+  if (write(fd, &rec, sizeof(rec)) != sizeof(rec))
+  {
+    std::cout << "\nWarning! result_cache: failed to write to " << filename << ". Caching disabled.\n";
+    if (ftruncate(fd, st.st_size) != 0)
+    {
+      std::cout << "\nWarning! result_cache: cannot truncate " << filename << ".\n";
+    }
+    flock(fd, LOCK_UN);
+    if (map != NULL) munmap((void *) map, map_size);
+    map = NULL; map_size = 0;
+    close(fd); fd = -1;
+    return;
+  }
+  flock(fd, LOCK_UN);
+};
+
+// ---------------------------------------------------------------------------
+int result_cache::size()
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  refresh();
+  return n_indexed;
+};
@@ -0,0 +1,314 @@
+// Destinations for the results of a scan which are written as soon as each
+// point is evaluated.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#include "result_sink.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------
+void result_sink::write(int index, const scan_point & point, std::complex<double> value)
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  buffer.push_back({index, point, value});
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - last_flush;
+  if (buffer.size() >= flush_points || elapsed.count() >= flush_seconds) flush_locked();
+};
+
+void result_sink::flush()
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  flush_locked();
+};
+
+void result_sink::flush_locked()
+{
+  if (!buffer.empty()) write_block(buffer);
+  buffer.clear();
+  last_flush = std::chrono::steady_clock::now();
+};
+
+// ---------------------------------------------------------------------------
+// Size of a file opened for reading
+static long file_size(FILE * file)
+{
+  fseek(file, 0, SEEK_END);
+  return ftell(file);
+};
+
+// Push the written data out to the disk
+static bool sync_file(FILE * file)
+{
+  return (fflush(file) == 0) && (fsync(fileno(file)) == 0);
+};
+
+// Close the file after a failed write, so a partial record isnt followed by
+// more, and report it
+static void write_failed(FILE * & file, std::string where, std::string filename)
+{
+  fclose(file);
+  file = NULL;
+  throw triangle_error(where, "failed to write to " + filename);
+};
+
+// The destructors cant throw, so anything failing when they close the file
+// is only reported
+static void close_quietly(result_sink * sink)
+{
+  try
+  {
+    sink->close();
+  }
+  catch (triangle_error & e)
+  {
+    std::cout << "\nWarning! " << e.what() << ".\n";
+  }
+};
+
+// First line of a csv file with the settings of the scan
+static const char * csv_config = "# mDec=%.17g,n=%d,l=%d,method=%d,tol=%.17g\n";
+
+// ---------------------------------------------------------------------------
+// Read back the points of a previous run and append to the file
+csv_sink::csv_sink(std::string file, scan_config xconfig)
+: filename(file), config(xconfig)
+{
+  FILE * in = fopen(filename.c_str(), "r");
+  if (in != NULL)
+  {
+    // Offset after the last complete line, a line cut off by a crash is dropped
+    long good = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), in) != NULL)
+    {
+      if (line[strlen(line) - 1] != '\n') break;
+
+      // The first line has to hold the same settings
+      if (good == 0)
+      {
+        scan_config old;
+        if (sscanf(line, "# mDec=%lf,n=%d,l=%d,method=%d,tol=%lf", &old.mDec, &old.n, &old.l, &old.method, &old.tol) != 5)
+        {
+          fclose(in);
+          throw triangle_error("csv_sink", filename + " is not a file of scan results");
+        }
+        if (!(old == config))
+        {
+          fclose(in);
+          throw triangle_error("csv_sink", filename + " was written by a scan with different settings");
+        }
+      }
+      good = ftell(in);
+
+      // The header doesnt match and is skipped
+      scan_result x;
+      double re, im;
+      if (sscanf(line, "%d,%d,%lf,%lf,%lf,%lf", &x.index, &x.point.id, &x.point.s, &x.point.t, &re, &im) == 6)
+      {
+        x.value = re + xi * im;
+        loaded[x.index] = x;
+      }
+    }
+
+    long size = file_size(in);
+    fclose(in);
+
+    if (size > good && truncate(filename.c_str(), good) != 0)
+    {
+      throw triangle_error("csv_sink", "cannot remove the incomplete last line of " + filename);
+    }
+  }
+
+  out = fopen(filename.c_str(), "a");
+  if (out == NULL)
+  {
+    throw triangle_error("csv_sink", "cannot open " + filename);
+  }
+
+  if (file_size(out) == 0)
+  {
+    fprintf(out, csv_config, config.mDec, config.n, config.l, config.method, config.tol);
+    fprintf(out, "index,id,s,t,re,im\n");
+    if (!sync_file(out)) write_failed(out, "csv_sink", filename);
+  }
+};
+
+csv_sink::~csv_sink()
+{
+  close_quietly(this);
+};
+
+void csv_sink::close()
+{
+  if (out == NULL) return;
+  flush();
+  fclose(out);
+  out = NULL;
+};
+
+// ---------------------------------------------------------------------------
+// Enough digits that the points read back are exactly the same
+void csv_sink::write_block(const std::vector<scan_result> & block)
+{
+  if (out == NULL)
+  {
+    throw triangle_error("csv_sink", filename + " is already closed");
+  }
+
+  for (int i = 0; i < block.size(); i++)
+  {
+    const scan_result & x = block[i];
+    fprintf(out, "%d,%d,%.17g,%.17g,%.17g,%.17g\n", x.index, x.point.id, x.point.s, x.point.t,
+            std::real(x.value), std::imag(x.value));
+  }
+
+  if (!sync_file(out)) write_failed(out, "csv_sink", filename);
+};
+
+// ---------------------------------------------------------------------------
+// Read back the records of a previous run and append to the file
+binary_sink::binary_sink(std::string file, scan_config xconfig)
+: filename(file), config(xconfig)
+{
+  FILE * in = fopen(filename.c_str(), "rb");
+  if (in != NULL)
+  {
+    // Offset after the last complete record, a record cut off by a crash is dropped
+    // The version is checked as soon as its there, older files have a shorter header
+    long good = 0;
+    header head;
+    std::memset(&head, 0, sizeof(head));
+    size_t got = fread(&head, 1, sizeof(head), in);
+    bool ours = std::strncmp(head.magic, "KTSCAN", std::min(got, (size_t) 6)) == 0;
+    if (got >= offsetof(header, mDec)) ours = ours && (head.version == version) && (head.record_size == sizeof(record));
+    if (!ours)
+    {
+      fclose(in);
+      throw triangle_error("binary_sink", filename + " is not a compatible file of scan results");
+    }
+
+    if (got == sizeof(head))
+    {
+      scan_config old;
+      old.mDec = head.mDec; old.tol = head.tol;
+      old.n = head.n; old.l = head.l; old.method = head.method;
+      if (!(old == config))
+      {
+        fclose(in);
+        throw triangle_error("binary_sink", filename + " was written by a scan with different settings");
+      }
+      good = sizeof(head);
+
+      record rec;
+      while (fread(&rec, sizeof(rec), 1, in) == 1)
+      {
+        good += sizeof(rec);
+        scan_result x = {rec.index, {rec.s, rec.t, rec.id}, rec.re + xi * rec.im};
+        loaded[x.index] = x;
+      }
+    }
+
+    long size = file_size(in);
+    fclose(in);
+
+    if (size > good && truncate(filename.c_str(), good) != 0)
+    {
+      throw triangle_error("binary_sink", "cannot remove the incomplete last record of " + filename);
+    }
+  }
+
+  out = fopen(filename.c_str(), "ab");
+  if (out == NULL)
+  {
+    throw triangle_error("binary_sink", "cannot open " + filename);
+  }
+
+  if (file_size(out) == 0)
+  {
+    header head;
+    std::memset(&head, 0, sizeof(head));
+    std::strncpy(head.magic, "KTSCAN", sizeof(head.magic));
+    head.version = version;
+    head.record_size = sizeof(record);
+    head.mDec = config.mDec; head.tol = config.tol;
+    head.n = config.n; head.l = config.l; head.method = config.method;
+    if (fwrite(&head, sizeof(head), 1, out) != 1 || !sync_file(out))
+    {
+      write_failed(out, "binary_sink", filename);
+    }
+  }
+};
+
+binary_sink::~binary_sink()
+{
+  close_quietly(this);
+};
+
+void binary_sink::close()
+{
+  if (out == NULL) return;
+  flush();
+  fclose(out);
+  out = NULL;
+};
+
+// ---------------------------------------------------------------------------
+void binary_sink::write_block(const std::vector<scan_result> & block)
+{
+  if (out == NULL)
+  {
+    throw triangle_error("binary_sink", filename + " is already closed");
+  }
+
+  std::vector<record> recs(block.size());
+  for (int i = 0; i < block.size(); i++)
+  {
+    std::memset(&recs[i], 0, sizeof(record));
+    recs[i].index = block[i].index; recs[i].id = block[i].point.id;
+    recs[i].s = block[i].point.s;   recs[i].t = block[i].point.t;
+    recs[i].re = std::real(block[i].value); recs[i].im = std::imag(block[i].value);
+  }
+
+  if (fwrite(recs.data(), sizeof(record), recs.size(), out) != recs.size() || !sync_file(out))
+  {
+    write_failed(out, "binary_sink", filename);
+  }
+};
+
+// ---------------------------------------------------------------------------
+plot_sink::~plot_sink()
+{
+  close_quietly(this);
+};
+
+void plot_sink::write_block(const std::vector<scan_result> & block)
+{
+  for (int i = 0; i < block.size(); i++)
+  {
+    results[block[i].index] = block[i];
+    if (inner != NULL) inner->write(block[i].index, block[i].point, block[i].value);
+  }
+};
+
+// Everything is passed on to the inner sink before plotting
+// so nothing is lost if the plotting fails
+void plot_sink::close()
+{
+  flush();
+  if (inner != NULL) inner->flush();
+
+  if (plotted || !plot) return;
+  plotted = true;
+
+  std::vector<scan_result> sorted;
+  for (auto x = results.begin(); x != results.end(); ++x) sorted.push_back(x->second);
+  plot(sorted);
+};
@@ -0,0 +1,103 @@
+// Kernels for each available combination of spins, specialized at compile time
+// so the inner loops of the integrations contain no branching on the channel.
+//
+// Author:       Daniel Winney (2020)
+// Affiliation:  Joint Physics Analysis Center (JPAC)
+// Email:        dwinney@iu.edu
+// ---------------------------------------------------------------------------
+
+#include <string>
+
+#include "spin_channels.hpp"
+
+// ---------------------------------------------------------------------------
+// Map the runtime channel id to the compile-time kernels
+projection_kernel get_projection_kernel(int id)
+{
+  switch (id)
+  {
+    case      0: return &spin_channel<0>::projection;
+    case      1: return &spin_channel<1>::projection;
+    case     10: return &spin_channel<10>::projection;
+    case     11: return &spin_channel<11>::projection;
+    case     20: return &spin_channel<20>::projection;
+    case  10000: return &spin_channel<10000>::projection;
+    case -11111: return &spin_channel<-11111>::projection;
+    default:     return NULL;
+  }
+};
+
+feynman_kernel get_feynman_kernel(int id)
+{
+  switch (id)
+  {
+    case      0: return &spin_channel<0>::feynman;
+    case      1: return &spin_channel<1>::feynman;
+    case     10: return &spin_channel<10>::feynman;
+    case     11: return &spin_channel<11>::feynman;
+    case     20: return &spin_channel<20>::feynman;
+    case  10000: return &spin_channel<10000>::feynman;
+    case -11111: return &spin_channel<-11111>::feynman;
+    default:     return NULL;
+  }
+};
+
+int get_projection_nQ(int id)
+{
+  switch (id)
+  {
+    case      0: return spin_channel<0>::nQ;
+    case      1: return spin_channel<1>::nQ;
+    case     10: return spin_channel<10>::nQ;
+    case     11: return spin_channel<11>::nQ;
+    case     20: return spin_channel<20>::nQ;
+    case  10000: return spin_channel<10000>::nQ;
+    case -11111: return spin_channel<-11111>::nQ;
+    default:     return 0;
+  }
+};
+
+int get_spectral_power(int id)
+{
+  switch (id)
+  {
+    case      0: return spin_channel<0>::power;
+    case      1: return spin_channel<1>::power;
+    case     10: return spin_channel<10>::power;
+    case     11: return spin_channel<11>::power;
+    case     20: return spin_channel<20>::power;
+    case  10000: return spin_channel<10000>::power;
+    case -11111: return spin_channel<-11111>::power;
+    default:     return 0;
+  }
+};
+
+// ---------------------------------------------------------------------------
+// Capability query for a channel
+bool channel_available(int id)
+{
+  return (get_projection_kernel(id) != NULL) && (get_feynman_kernel(id) != NULL)
+      && (get_projection_nQ(id) <= max_nQ);
+};
+
+void check_channel(quantum_numbers * qns)
+{
+  if (!channel_available(qns->id()))
+  {
+    throw triangle_error("check_channel", "j = " + std::to_string(qns->j)
+                         + " and j' = " + std::to_string(qns->jp)
+                         + " (code " + std::to_string(qns->id()) + ") combination not available");
+  }
+
+  if (qns->n < 0)
+  {
+    throw triangle_error("check_channel", "integral does not converge with n = "
+                         + std::to_string(qns->n) + " subtractions");
+  }
+
+  // kinematics::Q only fills the Q_l for l >= 0
+  if (qns->l < 0)
+  {
+    throw triangle_error("check_channel", "l = " + std::to_string(qns->l) + " must be non-negative");
+  }
+};